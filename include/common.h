@@ -7,6 +7,59 @@
 
 #define DEFAULT_QUANTUM_SIZE 500
 #define DEFAULT_CACHE_SIZE 500
+#define REQUEST_SIZE 5  // число int в одной записи посылки вспомогательному потоку
+#define MAX_QUANTUMS_IN_REQUEST 4096  // наибольшее число квантов, запрашиваемых одной посылкой (каждому соответствует свой тег)
+#define MAX_PENDING_REQUESTS 256  // наибольшее число одновременно незавершённых асинхронных запросов квантов
+#define MAX_LOCK_WAITERS 256  // наибольшее число потоков процесса, одновременно ожидающих разрешения на блокировку кванта
+#define MAX_COMPUTE_THREADS 256  // наибольшее число одновременно существующих потоков процесса, записывавших в кванты без мьютекса
+#define REPLY_SIZE 2  // число int в ответе каталога на запрос кванта: номер процесса, передающего квант, и номер ячейки кванта в его памяти
+#define MAX_SLABS 32  // наибольшее число блоков памяти распределителя (размер блока удваивается)
+#define MAX_USER_OPS 32  // наибольшее число операций пользователя для accumulate и fetch_and_op
+#define ACCUMULATE_BATCH 256  // число записей accumulate в посылке части каталога, после которого посылки отправляются, не дожидаясь синхронизации
+
+#ifndef NUMBER_OF_MASTER_HELPERS
+    #define NUMBER_OF_MASTER_HELPERS 2  // число потоков, обслуживающих часть каталога на каждом процессе; поток t обслуживает структуры с key % NUMBER_OF_MASTER_HELPERS == t
+#endif
+
+#ifndef ENABLE_RMA_READ_ONLY
+    #define ENABLE_RMA_READ_ONLY false  // кванты в READ_ONLY режиме читаются через MPI_Get без участия вспомогательного потока владельца
+#endif
+
+#ifndef ENABLE_OWNER_HINTS
+    #define ENABLE_OWNER_HINTS true  // READ_ONLY квант сначала запрашивается у процесса, от которого он был получен в прошлый раз, без обращения к каталогу
+#endif
+
+#ifndef LEASE_TIME_US
+    #define LEASE_TIME_US 0  // время в микросекундах, в течение которого полученный READ_WRITE квант не передаётся следующему владельцу; 0 - без аренды
+#endif
+
+#ifndef LEASE_ACCESSES
+    #define LEASE_ACCESSES 0  // аренда заканчивается раньше, если к кванту выполнено столько обращений без мьютекса; 0 - только по времени
+#endif
+
+#ifndef ALLOCATOR_ALIGNMENT
+    #define ALLOCATOR_ALIGNMENT 64  // выравнивание блоков распределителя и квантов размером от ALLOCATOR_ALIGNMENT байт (степень двойки)
+#endif
+
+#ifndef ENABLE_HUGE_PAGES
+    #define ENABLE_HUGE_PAGES false  // блоки распределителя от HUGE_PAGE_SIZE байт выравниваются по большой странице и отображаются на большие страницы (Linux)
+#endif
+
+#ifndef HUGE_PAGE_SIZE
+    #define HUGE_PAGE_SIZE (2 << 20)
+#endif
+
+#ifndef DEFAULT_CACHE_POLICY
+    #define DEFAULT_CACHE_POLICY CACHE_LRU  // алгоритм вытеснения из кеша структур, для которых он не задан (cache_policies)
+#endif
+
+#ifndef DEFAULT_CACHE_BUDGET
+    #define DEFAULT_CACHE_BUDGET 0  // байт на процесс для READ_ONLY копий квантов всех структур; 0 - у каждой структуры свой кеш из cache_size квантов
+#endif
+
+#ifndef LFU_MAX_FREQUENCY
+    #define LFU_MAX_FREQUENCY 16  // LFU: число обращений к кванту в кеше учитывается до этого значения
+#endif
 
 #ifndef ENABLE_STATISTICS_COLLECTION
     #define ENABLE_STATISTICS_COLLECTION true
@@ -29,6 +82,14 @@
         #define ENABLE_STATISTICS_QUANTUMS_CNT_WORKERS true
     #endif
 
+    #ifndef ENABLE_STATISTICS_MESSAGES_CNT
+        #define ENABLE_STATISTICS_MESSAGES_CNT true
+    #endif
+
+    #ifndef ENABLE_STATISTICS_MIGRATIONS_CNT
+        #define ENABLE_STATISTICS_MIGRATIONS_CNT true
+    #endif
+
 #endif
 
 #if (ENABLE_STATISTICS_COLLECTION)
@@ -37,14 +98,29 @@
 
 enum mods {  // используется для изменения режима работы с памятью
     READ_ONLY,
-    READ_WRITE
+    READ_WRITE,
+    WRITE_SHARED  // процессы записывают разные элементы кванта в свои копии, изменения сливаются у владельца при смене режима
+};
+
+enum distributions {  // размещение квантов по процессам-рабочим при создании структуры
+    NO_DISTRIBUTION,  // квант размещается на процессе, первым обратившимся к нему
+    BLOCK,            // непрерывные диапазоны квантов
+    CYCLIC,           // квант q - на рабочем q % worker_size
+    BLOCK_CYCLIC,     // блоки по block_size квантов по кругу
+    CUSTOM            // процесс задаёт функция пользователя
+};
+
+enum cache_policies {  // алгоритм вытеснения квантов из кеша структуры
+    CACHE_LRU,    // вытесняется квант, к которому дольше всего не обращались
+    CACHE_CLOCK,  // приближение LRU: при обращении ставится бит, вытесняется первый по кругу квант без бита
+    CACHE_2Q,     // квант попадает в основную очередь LRU при повторном промахе, однократный просмотр вытесняет только очередь FIFO
+    CACHE_ARC,    // адаптивно делит кеш между квантами с одним и с несколькими обращениями по истории вытесненных квантов
+    CACHE_LFU     // вытесняется квант с наименьшим числом обращений, среди них - дольше всего не использовавшийся
 };
 
 enum tags {  // используется для корректного распределения пересылок данных через MPI
     GET_DATA_FROM_HELPER             = 100,
     SEND_DATA_TO_HELPER              = 101,
-    SEND_DATA_TO_MASTER_HELPER       = 102,
-    GET_DATA_FROM_MASTER_HELPER_LOCK = 103,
     GET_INFO_FROM_MASTER_HELPER      = 104,
     GET_PERMISSION_FOR_CHANGE_MODE   = 105,
     GET_PERMISSION_TO_CONTINUE       = 106,
@@ -53,19 +129,52 @@ enum tags {  // используется для корректного расп
     REDUCE_ALL_TAG2                  = 109,
     NOTIFY                           = 110,
     FINALIZE_WORKER                  = 111,
-    FINALIZE_MASTER                  = 112
+    FINALIZE_MASTER                  = 112,
+    PRINT_FINISHED                   = 113,
+    GET_GRANT_FROM_HELPER            = 114,  // квант, пересланный владельцем вместе с правом владения
+    GET_HINTED_DATA_FROM_HELPER      = 115,  // квант, запрошенный у предполагаемого владельца; пустое сообщение - кванта у него нет
+    ACCUMULATE_DONE                  = 116,  // число выполненных владельцем операций ACCUMULATE данного процесса
+    GET_FETCH_RESULT_FROM_HELPER     = 117,  // прежнее значение элемента, изменённого FETCH_AND_OP
+    OBJECT_DESTROYED                 = 118,  // вспомогательный поток получил DESTROY от части каталога, посылок по структуре от неё больше не будет
+    GET_RANGE_DATA_FROM_HELPER       = 1000,  // начальный тег для квантов, запрошенных одной посылкой
+    GET_ASYNC_INFO_FROM_MASTER_HELPER = 6000,  // начальный тег для ответов каталога на асинхронные запросы
+    GET_ASYNC_DATA_FROM_HELPER       = 7000,  // начальный тег для квантов, запрошенных асинхронно
+    SEND_DATA_TO_MASTER_HELPER       = 8000,  // начальный тег посылок каталогу, поток каталога t принимает посылки с тегом 8000 + t
+    GET_LOCK_FROM_MASTER_HELPER      = 9000,  // начальный тег разрешений на блокировку кванта, у каждого ожидающего потока свой
+    REPLICATE_DATA                   = 10000  // начальный тег для квантов, рассылаемых деревом при смене режима на READ_ONLY
 };
 
 enum operations {  // используется вспомогательными потоками для определения типа запрашиваемой операции
-    GET_DATA_RW = 0,
-    GET_DATA_R  = 1,
-    SET_INFO    = 2,
-    GET_INFO    = 3,
-    LOCK        = 4,
-    UNLOCK      = 5,
-    CHANGE_MODE = 6,
-    PRINT       = 7,
-    DELETE      = 8
+    GET_DATA_RW  = 0,
+    GET_DATA_R   = 1,
+    SET_INFO     = 2,
+    GET_INFO     = 3,
+    LOCK         = 4,
+    UNLOCK       = 5,
+    CHANGE_MODE  = 6,
+    PRINT        = 7,
+    DELETE       = 8,
+    TRY_GET_INFO = 9,  // получить квант, ответ собирается в общий вектор ответов на посылку
+    EVICT        = 10,  // процесс удалил квант из кеша
+    GET_GRANT    = 11,  // получить квант в READ_WRITE режиме: владелец пересылает квант вместе с правом владения, каталог отвечает, только если пересылки не будет
+    GET_DATA_HINT = 12,  // запрос READ_ONLY кванта у предполагаемого владельца в обход каталога
+    ACCUMULATE   = 13,  // применить операцию к элементу на процессе-владельце кванта, за записью следуют данные операции
+    FETCH_AND_OP = 14,  // то же с возвратом прежнего значения элемента
+    DIFF         = 15,  // записать в копию владельца элементы, изменённые процессом в WRITE_SHARED режиме, за записью следуют их значения
+    DESTROY      = 16,  // процесс уничтожает структуру; часть каталога, получив DESTROY от всех рабочих, освобождает свои кванты и пересылает DESTROY рабочим
+    NUMBER_OF_OPERATIONS
+};
+
+enum accumulate_ops {  // операции accumulate и fetch_and_op, операции пользователя нумеруются начиная с NUMBER_OF_ACCUMULATE_OPS
+    OP_SUM,
+    OP_PROD,
+    OP_MIN,
+    OP_MAX,
+    OP_BAND,  // побитовые операции - только для целых типов
+    OP_BOR,
+    OP_BXOR,
+    OP_REPLACE,  // записать значение, с fetch_and_op - обмен
+    NUMBER_OF_ACCUMULATE_OPS
 };
 
 enum StatusCode {
@@ -95,6 +204,40 @@ static std::string get_error_code(int error_code) {
     return out;
 }
 
+inline std::string get_operation_name(int operation) {
+    switch(operation) {
+    case GET_DATA_RW:  return "GET_DATA_RW";
+    case GET_DATA_R:   return "GET_DATA_R";
+    case SET_INFO:     return "SET_INFO";
+    case GET_INFO:     return "GET_INFO";
+    case LOCK:         return "LOCK";
+    case UNLOCK:       return "UNLOCK";
+    case CHANGE_MODE:  return "CHANGE_MODE";
+    case PRINT:        return "PRINT";
+    case DELETE:       return "DELETE";
+    case TRY_GET_INFO: return "TRY_GET_INFO";
+    case EVICT:        return "EVICT";
+    case GET_GRANT:    return "GET_GRANT";
+    case GET_DATA_HINT: return "GET_DATA_HINT";
+    case ACCUMULATE:   return "ACCUMULATE";
+    case FETCH_AND_OP: return "FETCH_AND_OP";
+    case DIFF:         return "DIFF";
+    case DESTROY:      return "DESTROY";
+    default:           return std::to_string(operation);
+    }
+}
+
+inline std::string get_cache_policy_name(int policy) {
+    switch(policy) {
+    case CACHE_LRU:   return "LRU";
+    case CACHE_CLOCK: return "CLOCK";
+    case CACHE_2Q:    return "2Q";
+    case CACHE_ARC:   return "ARC";
+    case CACHE_LFU:   return "LFU";
+    default:          return std::to_string(policy);
+    }
+}
+
 #define CHECK(expression, error_code)                                                                                \
     if (!(expression)) {                                                                                             \
         int rank;                                                                                                    \
@@ -7,6 +7,7 @@
 #include <type_traits>
 
 #include <mpi.h>
+#include "common.h"
 
 template <class T>
 MPI_Datatype create_mpi_type(int count, const int* blocklens, const MPI_Aint* indices, const MPI_Datatype* types) {
@@ -139,4 +140,36 @@ MPI_Datatype get_mpi_type() noexcept {
     return mpi_type;
 }
 
+// встроенные операции accumulate: false, если операция не определена для типа
+template <class T>
+bool apply_bitwise_op(int op, T& a, const T& b, std::true_type) {
+    switch (op) {
+    case OP_BAND: a = a & b; return true;
+    case OP_BOR:  a = a | b; return true;
+    case OP_BXOR: a = a ^ b; return true;
+    default:      return false;
+    }
+}
+
+template <class T>
+bool apply_bitwise_op(int, T&, const T&, std::false_type) {
+    return false;
+}
+
+template <class T>
+bool apply_arithmetic_op(int op, T& a, const T& b, std::true_type) {
+    switch (op) {
+    case OP_SUM:  a = a + b; return true;
+    case OP_PROD: a = a * b; return true;
+    case OP_MIN:  if (b < a) a = b; return true;
+    case OP_MAX:  if (a < b) a = b; return true;
+    default:      return apply_bitwise_op(op, a, b, std::is_integral<T>());
+    }
+}
+
+template <class T>
+bool apply_arithmetic_op(int, T&, const T&, std::false_type) {
+    return false;
+}
+
 #endif // __DETAIL_H__
@@ -1,24 +1,67 @@
 #ifndef __MEMORY_ALLOCATOR_H__
 #define __MEMORY_ALLOCATOR_H__
 
-#include <vector>
-#include <queue>
 #include <mutex>
+#include <atomic>
+#include <mpi.h>
 #include "common.h"
 
+// кванты выделяются из блоков, блок k содержит 2^k квантов. Квант выдаётся из блока с наименьшим номером, в котором есть место,
+// поэтому при уменьшении числа квантов освобождаются старшие блоки, и их страницы возвращаются системе.
+// Распределитель записывает только в освобождённые кванты: страницы блока впервые затрагивает поток, который принимает или записывает квант.
+// alloc и free не захватывают мьютекс: освобождённые кванты блока образуют стек (стек Трайбера), номер следующего кванта стека хранится
+// в начале самого кванта, вершина - номер кванта с меткой, которая меняется при каждом изменении стека. Потоки вычислений не записывают
+// в освобождённые кванты: память переданного кванта возвращается распределителю только после смены эпохи всеми потоками (memory_manager::retire).
+// Мьютекс нужен только для добавления блока и возврата страниц системе
 class memory_allocator {
-    int st = 1;
-    int quantum_size;
-    std::vector<char*> memory {};  // структура для хранения указателей на кванты памяти
-    std::queue<char*> free_quantums {};  // очередь свободных квантов
+    struct slab_info {
+        std::atomic<unsigned long long> head {0};  // вершина стека: метка в старших 32 битах, номер кванта + 1 в младших, 0 - стек пуст
+        std::atomic<int> used {0};  // кванты [0, used) блока выдавались, остальные ещё не затрагивались
+        // число выданных квантов вместе с зарезервированными потоками, которые ищут квант в блоке; пока оно не нулевое, блок
+        // не освобождается. При возврате страниц системе к счётчику прибавляется SLAB_RELEASING, и потоки пропускают блок
+        std::atomic<int> allocated {0};
+        bool is_mapped = false;  // блок отображён через mmap, его страницы можно вернуть системе, сохранив адрес блока
+    };
+    static const int SLAB_RELEASING = -(1 << 30);
+    int quantum_size = 0;  // размер кванта в байтах
+    int stride = 0;  // расстояние между квантами в блоке, кванты от ALLOCATOR_ALIGNMENT байт выровнены, не меньше sizeof(int)
+    char* memory[MAX_SLABS] = {};  // блоки памяти
+    slab_info slabs_info[MAX_SLABS];
+    std::atomic<int> number_of_slabs {0};
     std::mutex lock;
+#if (ENABLE_RMA_READ_ONLY)
+    MPI_Aint slabs[MAX_SLABS] = {};  // адреса блоков памяти в окне, читаются другими процессами через MPI_Get
+    MPI_Win win = MPI_WIN_NULL;
+#endif
 public:
     char* alloc();
     void free(char** quantum);
     void set_quantum_size(int size_quantum, int size_of);
+#if (ENABLE_RMA_READ_ONLY)
+    // ячейки квантов нумеруются подряд по блокам: блок k содержит 2^k квантов, начиная с ячейки 2^k - 1
+    void attach(MPI_Win window);  // открыть память распределителя для чтения другими процессами через окно
+    void detach();
+    MPI_Aint get_slabs_address();  // адрес таблицы блоков в окне
+    int get_slot(const char* quantum);  // номер ячейки кванта
+    static int get_slab(int slot);  // номер блока, содержащего ячейку
+    MPI_Aint get_offset(int slot);  // смещение ячейки от начала блока в байтах
+#endif
     ~memory_allocator();
 private:
     void resize_internal();
+    bool pop(int slab, char*& quantum);  // взять квант из стека освобождённых квантов блока
+    bool bump(int slab, char*& quantum);  // взять ещё не выдававшийся квант блока
+    void push(int slab, char* quantum);
+    bool has_room_below(int slab);  // есть ли место в блоках с меньшими номерами
+    int find_slab(const char* quantum);  // номер блока, содержащего квант
+    size_t get_slab_bytes(int slab);
+    // вернуть системе страницы свободных блоков, если в младших блоках есть место: блок, из которого кванты выдаются следующими,
+    // сохраняется, чтобы выделение и освобождение одного кванта не отображали страницы заново. Вызывается, когда освободился блок,
+    // ниже которого есть место. Адреса блоков не меняются, поэтому номера ячеек и таблица блоков, прочитанная другими процессами,
+    // остаются верными
+    void release_free_slabs();
+    static char* map_slab(size_t bytes, bool& is_mapped);
+    static void unmap_slab(char* slab, size_t bytes, bool is_mapped);
 };
 
 #endif  // __MEMORY_ALLOCATOR_H__
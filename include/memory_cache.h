@@ -7,11 +7,16 @@
 #include <queue>
 #include <iostream>
 #include <fstream>
+#include <atomic>
+#include <memory>
 #include "common.h"
 
 struct cache_node {
     int value;
     cache_node* next, *prev;
+    int queue;  // номер очереди memory_cache, в которой находится узел
+    bool referenced;  // CLOCK: к кванту обращались после прохода стрелки
+    long long tick;  // время последнего обращения к кванту по общим для всех кешей часам
 };
 
 class cache_list {
@@ -23,27 +28,68 @@ public:
     cache_node* pop_back();
     void delete_node(cache_node* node);
     bool empty();
+    int get_size();
+    cache_node* front();
 };
 
+// кеш квантов структуры, алгоритм вытеснения задаётся при создании (cache_policies). Кванты, которые можно вытеснить, хранятся
+// в очередях queues, назначение очередей зависит от алгоритма. 2Q и ARC помнят номера недавно вытесненных квантов (призраки)
+// в отдельных очередях, призраки не занимают место в кеше
 class memory_cache {
 public:
     memory_cache();
-    memory_cache(int cache_size, int number_of_quantums, MPI_Comm workers_comm);
+    memory_cache(int cache_size, int number_of_quantums, MPI_Comm workers_comm, int policy = DEFAULT_CACHE_POLICY);
     memory_cache& operator=(const memory_cache& cache);
     memory_cache& operator=(memory_cache&& cache);
-    int add(int quantum_index);  // добавить элемент в кеш. Если при попытке добавления
-                                 // происходит замещение другого элемента, возвращается
-                                 // индекс замещаемого элемента
+    // добавить элемент в кеш. Если при попытке добавления происходит замещение другого элемента, возвращается индекс
+    // замещаемого элемента. При добавлении квантов одной посылки обращения без мьютекса не учитываются (can_fold_hits):
+    // квант, к которому обращались раньше, переместился бы в очереди за ещё не полученные кванты посылки и пережил бы их
+    int add(int quantum_index, bool can_fold_hits = true);
     bool is_contain(int quantum_index);
     void add_to_excluded(int quantum_index);
     bool is_excluded(int quantum_index);
     void delete_elem(int quantum_index);
-    void get_cache_miss_cnt_statistics(int key, int number_of_elements);
+    void pin(int quantum_index);  // исключить квант из вытеснения, квант должен находиться в кеше
+    void unpin(int quantum_index);
+    bool is_pinned(int quantum_index);
+    // обращение к кванту без мьютекса: вызывается из нескольких потоков, учитывается в очередях при следующем добавлении или вытеснении
+    void hit(int quantum_index);
+    int get_num_pinned();  // число закреплённых квантов, они не вытесняются и уменьшают доступное место в кеше
+    int get_cache_size();  // максимальное число квантов в кеше
+    int get_num_cached();  // число квантов в кеше вместе с закреплёнными
+    int get_cache_policy();
+    // вытеснить квант по алгоритму кеша, освободив место, возвращает номер кванта; -1 - все кванты закреплены.
+    // Используется при вытеснении квантов других структур в общем бюджете кеша
+    int evict_one();
+    long long get_coldest_tick();  // время последнего обращения к кванту, который будет вытеснен следующим, -1 - вытеснять нечего
+    static long long get_ticks();
+    void get_cache_miss_cnt_statistics(int key, long long number_of_elements);
 private:
+    static const int A1_IN = 0, AM = 1, A1_OUT = 2;  // очереди 2Q: FIFO квантов с одним обращением, LRU остальных, призраки A1_IN
+    static const int T1 = 0, T2 = 1, B1 = 2, B2 = 3;  // очереди ARC: LRU квантов с одним и с несколькими обращениями, их призраки
+    void touch(cache_node* node);  // обращение к кванту в кеше
+    void insert(cache_node* node, int ghost_queue);  // поместить квант в очередь после промаха, ghost_queue - очередь его призрака или -1
+    cache_node* evict(int ghost_queue);  // вынуть из очередей вытесняемый квант
+    int get_victim_queue(int ghost_queue);  // очередь, из начала которой вытесняется квант
+    bool has_unpinned();  // в очередях есть кванты, которые можно вытеснить
+    void fold_hits();  // учесть обращения без мьютекса к квантам в начале очередей, перед выбором вытесняемого кванта
+    void remember(int queue, int quantum_index);  // запомнить призрак вытесненного кванта
+    void forget(int quantum_index);  // удалить призрак кванта
+    void release_ghost(cache_node* node);  // вернуть вынутый из очереди узел призрака в список свободных
+    int get_num_resident_queues();  // очереди [0, get_num_resident_queues()) содержат кванты, остальные - призраки
+    static long long ticks;  // часы всех кешей процесса, идут при каждом обращении к кешу
+    int policy = DEFAULT_CACHE_POLICY;
+    int arc_target = 0;  // ARC: желаемое число квантов в T1, растёт при промахах по призракам B1 и уменьшается по призракам B2
     std::vector<bool> excluded {};
+    std::vector<bool> pinned {};  // закреплённые кванты находятся в кеше, но не в списке вытеснения
+    std::unique_ptr<std::atomic<bool>[]> hits;  // к кванту обращались без мьютекса после последнего учёта обращений
     std::vector<cache_node*> contain_flags {};
     std::vector<cache_node> cache_memory {};
-    cache_list free_cache_nodes {}, cache_indexes {};
+    cache_list free_cache_nodes {};
+    std::vector<cache_list> queues {};
+    std::vector<cache_node*> ghost_flags {};  // узел призрака кванта (2Q, ARC)
+    std::vector<cache_node> ghost_memory {};
+    cache_list free_ghost_nodes {};
     int rank, size;
     MPI_Comm workers_comm;
 #if (ENABLE_STATISTICS_COLLECTION)
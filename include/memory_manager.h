@@ -5,12 +5,18 @@
 #include <vector>
 #include <deque>
 #include <mutex>
+#include <atomic>
 #include <iostream>
 #include <fstream>
 #include <cassert>
 #include <string>
 #include <set>
 #include <memory>
+#include <cstring>
+#include <algorithm>
+#include <initializer_list>
+#include <functional>
+#include <climits>
 #include <mpi.h>
 #include "common.h"
 #include "detail.h"
@@ -19,23 +25,44 @@
 #include "memory_cache.h"
 
 void worker_helper_thread();
-void master_helper_thread();
+void master_helper_thread(int thread_index);
 
 struct quantum_common {
     int mode = READ_WRITE;
     bool is_mode_changed = false;
     int num_of_changed_mode_procs = 0;
-    virtual ~quantum_common() {}
 };
 
 struct quantum_worker
     : public quantum_common {
     void* quantum = nullptr; // указатель на квант
+    int pending = -1;  // номер незавершённого асинхронного запроса данного кванта
+    bool is_removing = false;  // квант вытеснен из кеша и ждёт освобождения по запросу DELETE
+    bool is_delete_deferred = false;  // DELETE пришёл, пока квант был закреплён, память освобождается при откреплении
+    int pins = 0;  // число представлений, закрепивших квант на процессе
+    int owner_hint = -1;  // процесс, от которого квант был получен в READ_ONLY режиме, -1 - неизвестен
+    void* twin = nullptr;  // копия кванта, полученного в WRITE_SHARED режиме от владельца, с ней сравнивается квант при смене режима
+    int deferred_to_rank = -1, deferred_tag = -1;  // запрос GET_DATA_RW, отложенный до открепления или до приёма кванта
+    std::vector<int> deferred_accumulates;  // записи ACCUMULATE и FETCH_AND_OP с данными, пришедшие до приёма кванта
+    double lease_start = 0;  // время приёма READ_WRITE кванта, до окончания аренды запрос GET_DATA_RW откладывается
+    std::unique_ptr<std::atomic<int>> lease_accesses;  // обращения без мьютекса с начала аренды
     std::unique_ptr<std::mutex> mutex;  // мьютекс нужен, чтобы предотвратить одновременный доступ
                                     // к кванту с разных потоков в режиме READ_WRITE
+    // версия кванта: бит 0 установлен, пока вспомогательный поток передаёт или освобождает квант, бит 1 - пока квант принимается,
+    // после каждого освобождения версия увеличивается на 4; обращение к кванту, находящемуся на процессе, выполняется без мьютекса
+    // и повторяется под мьютексом, если версия изменилась
+    std::unique_ptr<std::atomic<unsigned>> version;
+    std::unique_ptr<std::mutex> local_lock;  // захватывается потоком, вызвавшим set_lock, до unset_lock
     std::vector<int> cnt;
     std::vector<int> modes;
-    quantum_worker(): mutex(new std::mutex()) {}
+#if (ENABLE_STATISTICS_COLLECTION)
+    std::unique_ptr<std::atomic<int>> hits;  // обращения без мьютекса, относятся к последнему элементу cnt
+#endif
+    quantum_worker(): lease_accesses(new std::atomic<int>(0)), mutex(new std::mutex()), version(new std::atomic<unsigned>(0)), local_lock(new std::mutex()) {
+#if (ENABLE_STATISTICS_COLLECTION)
+        hits.reset(new std::atomic<int>(0));
+#endif
+    }
 };
 
 struct quantum_master
@@ -45,16 +72,34 @@ struct quantum_master
     std::deque<int> owners;  // для read_only mode, номера процессов, хранящих у себя квант
     std::vector<int> requests;  // хранит число текущих запросов по данному кванту для каждого процесса
     std::vector<bool> want_to_delete;  // флаг для хранения сведений о том, что есть запрос на удаление данного кванта на данном процессе
+    int migrations = 0;  // число передач права владения в READ_WRITE режиме между процессами
+#if (ENABLE_RMA_READ_ONLY)
+    std::vector<int> slots;  // номер ячейки кванта в памяти каждого процесса, сообщённый в SET_INFO
+#endif
 
     quantum_master(int number_of_procs): quantum_common(),
                                          requests(number_of_procs, 0),
-                                         want_to_delete(number_of_procs, false) {}
+                                         want_to_delete(number_of_procs, false) {
+#if (ENABLE_RMA_READ_ONLY)
+        slots.assign(number_of_procs, -1);
+#endif
+    }
+};
+
+struct distribution {  // размещение квантов при создании структуры
+    int kind = NO_DISTRIBUTION;
+    int block_size = 1;  // для BLOCK_CYCLIC
+    std::function<int(int)> mapping;  // для CUSTOM: номер кванта -> номер процесса-рабочего, должна давать одинаковый результат на всех процессах
+    distribution() {}
+    distribution(distributions kind, int block_size = 1): kind(kind), block_size(block_size) {}
+    distribution(std::function<int(int)> mapping): kind(CUSTOM), mapping(mapping) {}
+    int get_owner(int quantum_index, int num_of_quantums, int worker_size) const;  // номер процесса, на котором размещается квант, -1 - не размещается
 };
 
 struct memory_line_common {
-    int logical_size;  // общее число элементов в векторе на всех процессах
+    long long logical_size;  // общее число элементов в векторе на всех процессах; номера квантов и элементов в кванте - int
     int quantum_size;
-    virtual ~memory_line_common() {}
+    int size_of;  // размер элемента в байтах
 };
 
 struct memory_line_worker
@@ -62,43 +107,186 @@ struct memory_line_worker
     std::vector<quantum_worker> quantums;
     memory_allocator allocator;
     MPI_Datatype type;
-    int size_of;
+    void (*apply_op)(int op, char* elem, const char* value) = nullptr;  // применить операцию accumulate к элементу
     memory_cache cache;
+    distribution dist;
+    // память переданных квантов и номер эпохи передачи: в неё ещё может записывать поток вычислений, проверивший версию
+    // до передачи, поэтому распределителю она возвращается, когда все потоки вычислений перейдут в следующую эпоху
+    std::vector<std::pair<char*, unsigned long long>> retired;
+    std::mutex retired_mutex;
+#if (ENABLE_RMA_READ_ONLY)
+    MPI_Win win = MPI_WIN_NULL;  // окно над памятью распределителя, открытое всем рабочим
+    std::vector<MPI_Aint> slab_tables;  // адреса таблиц блоков распределителей рабочих
+    std::vector<std::vector<MPI_Aint>> remote_slabs;  // прочитанные таблицы блоков рабочих
+#endif
 };
 
-struct memory_line_master
+struct memory_line_master  // часть каталога квантов, хранящаяся на одном процессе
     : public memory_line_common {
+    int first_quantum_index = 0;  // номер первого кванта данной части каталога, quantums[i] соответствует кванту first_quantum_index + i
     std::vector<quantum_master> quantums;
     queue_quantums wait_locks;  // мапа очередей для процессов, ожидающих разблокировки кванта, заблокированных через set_lock
-    queue_quantums wait_quantums;  // мапа очередей для процессов, ожидающих разблокировки кванта, заблокированных процессом-мастером
+    bool is_replicate = false;  // при текущей смене режима какой-либо процесс запросил копии квантов
+    // процессы, приславшие CHANGE_MODE текущей смены режима: их следующие посылки по структуре откладываются до смены режима
+    std::vector<bool> changed_mode_procs;
+    int num_of_destroyed_procs = 0;  // число рабочих, приславших DESTROY
+};
+
+struct pending_request {  // незавершённый асинхронный запрос кванта
+    int key = -1;  // -1, если слот свободен
+    int quantum_index = -1;
+    int reply[REPLY_SIZE] = {-2, -1};  // ответ каталога
+    std::vector<std::pair<int, std::vector<char>>> writes;  // отложенные записи: смещение в кванте в байтах и значение
+};
+
+struct epoch_slot {  // слот эпохи потока вычислений, освобождается при завершении потока
+    std::atomic<unsigned long long>* epoch = nullptr;
+    ~epoch_slot() {
+        if (epoch != nullptr)
+            epoch->store(0, std::memory_order_release);
+    }
+};
+
+struct mode_change {  // смена режима, начатая change_mode_begin
+    int key = -1;  // -1, если смена режима не начата
+    int quantum_index_l = 0, quantum_index_r = 0;
+    mods mode = READ_WRITE;
+    int info[2] = {0, 0};  // запрошены ли копии и сколько квантов процесс примет без вытеснения
+    std::vector<int> infos;  // то же для всех рабочих
+    MPI_Request request = MPI_REQUEST_NULL;  // барьер рабочих
+};
+
+template <class T>
+class data_future {  // результат get_data_async и set_data_async
+    int key;
+    long long index_of_element;
+public:
+    data_future(int key, long long index_of_element): key(key), index_of_element(index_of_element) {}
+    void wait();  // дождаться получения кванта
+    T get();  // дождаться получения кванта и прочитать элемент
+};
 
+template <class T>
+class quantum_view {  // закреплённый квант: пока представление существует, квант не передаётся другим процессам и не вытесняется из кеша
+    int key = -1, quantum_index = -1;
+    T* ptr = nullptr;
+    int length = 0;
+public:
+    quantum_view() {}
+    quantum_view(int key, int quantum_index, T* ptr, int length): key(key), quantum_index(quantum_index), ptr(ptr), length(length) {}
+    quantum_view(const quantum_view&) = delete;
+    quantum_view& operator=(const quantum_view&) = delete;
+    quantum_view(quantum_view&& other);
+    quantum_view& operator=(quantum_view&& other);
+    ~quantum_view() { release(); }
+    T* data() const { return ptr; }
+    int size() const { return length; }  // число элементов в кванте
+    T& operator[](int i) const { return ptr[i]; }
+    T* begin() const { return ptr; }
+    T* end() const { return ptr + length; }
+    void release();  // открепить квант до уничтожения представления
 };
 
 class memory_manager {
-    static std::vector<memory_line_common*> memory;  // структура-хранилище памяти и вспомогательной информации
+    static std::vector<memory_line_worker*> memory;  // структура-хранилище памяти и вспомогательной информации, на процессе 0 хранятся только размеры
+    static std::vector<memory_line_master*> directory;  // часть каталога квантов, обслуживаемая данным процессом
     static std::thread helper_thr;  // вспомогательный поток
+    static std::vector<std::thread> master_helper_thrs;  // потоки, обслуживающие часть каталога квантов, каждый - свои структуры
     static int rank, size;  // ранг процесса в MPI и число процессов
     static int worker_rank, worker_size;  // worker_rank = rank-1, worker_size = size-1
-    static int proc_count_ready;
+    static thread_local int proc_count_ready;  // число рабочих, вызвавших print, у каждого потока каталога свой
     static MPI_File fh;
     static MPI_Comm workers_comm;
+    static std::vector<pending_request> pending;  // слоты асинхронных запросов, номер слота задаёт теги ответа и пересылки
+    // приём ответов каталога на асинхронные запросы (первые MAX_PENDING_REQUESTS) и приём квантов (следующие MAX_PENDING_REQUESTS), по одному на слот
+    static std::vector<MPI_Request> pending_info;
+    static int next_pending;  // слоты занимаются по кругу
+    static int pending_count;
+    static mode_change current_mode_change;  // незавершённая смена режима, начатая change_mode_begin
+    static std::vector<std::vector<int>> to_directory;  // записи частям каталога, накопленные потоком вычислений, по одной посылке на каждый поток каждой части каталога
+    static std::recursive_mutex compute_mutex;  // обращения потоков вычислений к каталогу и асинхронные запросы выполняются по одному
+    static std::vector<bool> lock_waiters;  // занятые слоты ожидания разрешения на блокировку, номер слота задаёт тег ответа каталога
+    // эпохи потоков вычислений: после каждого обращения к кванту без мьютекса поток записывает в свой слот текущую эпоху,
+    // 0 - слот свободен, OFFLINE_EPOCH - поток обращается к кванту под мьютексом. Передача кванта начинает новую эпоху, память кванта
+    // освобождается, когда все занятые слоты её достигнут. Поток, долго не обращающийся к квантам, задерживает освобождение, но не передачу квантов
+    static std::atomic<unsigned long long> global_epoch;
+    static std::atomic<unsigned long long> thread_epochs[MAX_COMPUTE_THREADS];
+    static thread_local std::atomic<unsigned long long>* thread_epoch;  // слот потока, nullptr - поток ещё не записывал без мьютекса
+    static thread_local epoch_slot thread_epoch_slot;
+    static const unsigned long long OFFLINE_EPOCH = ~0ULL;
+    struct offline_scope {  // на время промаха поток не задерживает освобождение памяти, после промаха снова записывает без мьютекса
+        offline_scope();
+        ~offline_scope();
+    };
+    static thread_local std::vector<std::vector<int>> to_helpers;  // записи вспомогательным потокам рабочих, накопленные потоком каталога при обработке одной посылки
+    static std::function<void(char*, const char*)> user_ops[MAX_USER_OPS];  // операции пользователя для accumulate
+    static int number_of_user_ops;
+    static int accumulates_in_flight;  // отправленные ACCUMULATE, о выполнении которых владельцы ещё не сообщили
+    static bool is_finalized;  // finalize выполнен, память всех структур освобождена
+    static long long cache_budget;  // байт на процесс для READ_ONLY копий квантов всех структур, 0 - без общего бюджета
+#if (ENABLE_STATISTICS_COLLECTION)
+  #if (ENABLE_STATISTICS_MESSAGES_CNT)
+    static std::vector<long long> records_cnt, messages_cnt;  // число записей и посылок каталогу по операциям, последний элемент - всего
+    static std::vector<long long> helper_records_cnt, helper_messages_cnt;  // то же для посылок каталога вспомогательным потокам
+    static std::mutex helper_statistics_mutex;  // посылки вспомогательным потокам считаются всеми потоками каталога
+  #endif
+#endif
 
 public:
     static void init(int argc, char** argv, std::string error_helper = "");  // функция, вызываемая в начале выполнения программы, инициирует вспомогательные потоки
     static int get_MPI_rank();
     static int get_MPI_size();
-    template <class T> static T get_data(int key, int index_of_element);  // получить элемент по индексу с любого процесса
-    template <class T> static void set_data(int key, int index_of_element, T value);  // сохранить значение элемента по индексу с любого процесса
-    template <class T> static int create_object(int count, const int* blocklens, const MPI_Aint* indices, const MPI_Datatype* types, int number_of_elements,
-                                                int quantum_size = DEFAULT_QUANTUM_SIZE, int cache_size = DEFAULT_CACHE_SIZE);
-    template <class T> static int create_object(int number_of_elements, int quantum_size = DEFAULT_QUANTUM_SIZE, int cache_size = DEFAULT_CACHE_SIZE);  // создать новый memory_line и занести его в memory
-    static int get_quantum_index(int key, int index);  // получить номер кванта по индексу
+    // задать общий для всех структур бюджет кеша процесса в байтах, 0 - у каждой структуры свой кеш из cache_size квантов.
+    // При заданном бюджете cache_size не используется: квант любой структуры вытесняет из кеша тот квант, к которому дольше всего
+    // не обращались, с учётом размера квантов. Вызывается до создания структур, к которым применяется бюджет
+    static void set_cache_budget(long long bytes);
+    template <class T> static T get_data(int key, long long index_of_element);  // получить элемент по индексу с любого процесса
+    template <class T> static void set_data(int key, long long index_of_element, T value);  // сохранить значение элемента по индексу с любого процесса
+    template <class T> static data_future<T> get_data_async(int key, long long index_of_element);  // запросить квант с элементом, не дожидаясь его получения
+    template <class T> static data_future<T> set_data_async(int key, long long index_of_element, T value);  // запись выполняется по получении кванта
+    static void wait_all_pending();  // завершить все асинхронные запросы
+    // получить квант и закрепить его на процессе; доступ через представление идёт по указателю без обращения к memory_manager.
+    // Представление в режиме READ_ONLY занимает место в кеше, запись через него запрещена в READ_ONLY режиме
+    template <class T> static quantum_view<T> acquire_view(int key, int quantum_index, mods mode);
+    template <class T, class F> static void parallel_for(int key, int num_threads, F func);  // применить func(index, elem) к элементам квантов, находящихся на процессе, в num_threads потоках
+    static void prefetch(int key, int quantum_index_l, int quantum_index_r, bool is_claim = false);  // асинхронно запросить кванты [l, r), READ_WRITE кванты запрашиваются только при is_claim
+    // применить op(элемент, value) к элементу на процессе-владельце кванта, квант не перемещается; записи накапливаются в посылках
+    // частям каталога, выполнение всех accumulate процесса гарантируется после wait_accumulates и точек синхронизации
+    // (wait_all, wait_all_workers, notify, unset_lock, change_mode)
+    template <class T> static void accumulate(int key, long long index_of_element, T value, int op);
+    template <class T> static T fetch_and_op(int key, long long index_of_element, T value, int op);  // то же, дождаться выполнения и вернуть прежнее значение
+    static void wait_accumulates();  // дождаться выполнения всех accumulate данного процесса
+    // зарегистрировать коммутативную операцию func(T, T) -> T, возвращает её номер; вызывается всеми процессами в одном порядке
+    template <class T, class F> static int create_op(F func);
+    template <class T> static void get_range(int key, long long l, long long r, T* out);  // получить элементы [l, r), недостающие кванты запрашиваются одной посылкой у каждой части каталога
+    template <class T> static void set_range(int key, long long l, long long r, const T* in);  // сохранить элементы [l, r), недостающие кванты запрашиваются одной посылкой у каждой части каталога
+    template <class T> static int create_object(int count, const int* blocklens, const MPI_Aint* indices, const MPI_Datatype* types, long long number_of_elements,
+                                                int quantum_size = DEFAULT_QUANTUM_SIZE, int cache_size = DEFAULT_CACHE_SIZE, const distribution& dist = distribution(),
+                                                int cache_policy = DEFAULT_CACHE_POLICY);
+    // создать новый memory_line и занести его в memory; при заданном распределении кванты сразу размещаются на процессах-рабочих
+    // в READ_WRITE режиме, заполненные нулями, и каталог знает их владельцев. cache_policy - алгоритм вытеснения из кеша (cache_policies)
+    template <class T> static int create_object(long long number_of_elements, int quantum_size = DEFAULT_QUANTUM_SIZE, int cache_size = DEFAULT_CACHE_SIZE,
+                                                const distribution& dist = distribution(), int cache_policy = DEFAULT_CACHE_POLICY);
+    // уничтожить структуру и освободить её кванты, кеш и части каталога на всех процессах; вызывается всеми процессами в одном порядке,
+    // как create_object. Идентификатор может быть выдан следующей созданной структуре. После finalize ничего не делает
+    static void destroy_object(int key);
+    static int get_initial_owner(int key, int quantum_index);  // процесс, на котором квант размещён при создании, -1 - не размещался
+    static void get_local_range(int key, long long& l, long long& r);  // элементы [l, r), размещённые на процессе при создании с распределением BLOCK
+    static int get_quantum_index(int key, long long index);  // получить номер кванта по индексу
     static int get_quantum_size(int key);  // получить размер кванта
     static void set_lock(int key, int quantum_index);  // заблокировать квант
     static void unset_lock(int key, int quantum_index);  // разблокировать квант
-    static void change_mode(int key, int quantum_index_l, int quantum_index_r, mods mode);  // сменить режим работы с памятью
-    template <class T> static void read(int key, const std::string& path, int number_of_elements);  // прочитать из файла number_of_elements элементов
-    template <class T> static void read(int key, const std::string& path, int number_of_elements, int offset, int num_of_elem_proc); // прочитать из файла со смещением от начала, равным offset,number_of_elements элементов
+    // сменить режим работы с памятью; при смене на READ_ONLY процессы с is_replica получают копии квантов [l, r) в пределах кеша
+    // рассылкой от владельцев по биномиальному дереву, и чтение начинается без обращений к каталогу.
+    // В WRITE_SHARED режиме процесс записывает элементы в свою копию кванта, при смене режима изменённые элементы
+    // пересылаются владельцу; разные процессы должны записывать разные элементы
+    static void change_mode(int key, int quantum_index_l, int quantum_index_r, mods mode, bool is_replica = false);
+    // change_mode в две фазы: между begin и end процесс выполняет свою работу, не обращаясь к квантам [l, r), пока другие процессы
+    // дойдут до смены режима; синхронизация - неблокирующий барьер рабочих, каталог ответа не рассылает
+    static void change_mode_begin(int key, int quantum_index_l, int quantum_index_r, mods mode, bool is_replica = false);
+    static void change_mode_end();
+    template <class T> static void read(int key, const std::string& path, long long number_of_elements);  // прочитать из файла number_of_elements элементов
+    template <class T> static void read(int key, const std::string& path, long long number_of_elements, long long offset, long long num_of_elem_proc); // прочитать из файла со смещением от начала, равным offset,number_of_elements элементов
     static void print(int key, const std::string& path);
     static MPI_Datatype get_MPI_datatype(int key);
     static void finalize();  // функция, завершающая выполнение программы, останавливает вспомогательные потоки
@@ -109,81 +297,250 @@ public:
     static void notify(int to_rank);  // возобновить работу процесса rank
 private:
     static void print_quantum(int key, int quantum_index);
+    static void range_access(int key, long long l, long long r, char* buffer, bool is_write);  // побайтовое копирование элементов [l, r) между квантами и buffer
+    static int get_home(int key, int quantum_index);  // номер процесса, хранящего часть каталога с данным квантом
+    static int get_first_quantum(int num_of_quantums, int process);  // номер первого кванта части каталога процесса process
+    static int get_master_helper(int key);  // номер потока каталога, обслуживающего структуру key
+    static void send_get_info(int key, int quantum_index, int removing_quantum_index, int reply_tag, int data_tag);  // добавить запрос кванта в посылку каталогу
+    static bool get_hinted_data(int key, int quantum_index);  // запросить READ_ONLY квант у процесса owner_hint в обход каталога, false - кванта у него нет
+    static int get_info(int key, int quantum_index, int removing_quantum_index);  // запросить и принять квант, возвращает номер процесса, передавшего квант
+    static int get_slot(int key, int quantum_index);  // номер ячейки кванта в памяти распределителя, -1 без RMA
+    static void read_quantum(int key, int quantum_index, int from_rank, int slot);  // начать чтение кванта из памяти процесса from_rank через MPI_Get
+    static void wait_reads(int key);  // дождаться завершения всех чтений через MPI_Get
+    // добавить квант в кеш, возвращает номер вытесненного кванта структуры; кванты других структур, вытесненные по бюджету кеша,
+    // отмечаются вытесненными здесь же. can_evict_own - по бюджету можно вытеснить квант той же структуры
+    static int cache_add(int key, int quantum_index, bool can_evict_own = true);
+    // вытеснять кванты, пока квант структуры key не поместится в бюджет кеша, возвращает вытесненный квант структуры key или -1
+    static int fit_cache_budget(int key, bool can_evict_own);
+    static void mark_removing(int key, int quantum_index);  // квант вытеснен из кеша: его память освобождается по запросу DELETE
+    static long long get_cached_bytes();  // байт в кешах всех структур процесса
+    static void reserve_quantum(int key, int quantum_index);  // подготовить память кванта перед запросом у каталога
+    static void reset_mode_changed(int key, int quantum_index);  // отметить полученный квант актуальным
+    static void set_received(int key, int quantum_index);  // данные кванта приняты, обращения без мьютекса снова разрешены, отложенный запрос GET_DATA_RW выполняется
+    static void count_hit(quantum_worker& quantum);  // учесть обращение к кванту без мьютекса в статистике и в аренде
+    static void register_thread();  // занять слот эпохи перед первой записью потока без мьютекса
+    static void quiescent();  // поток не обращается к квантам без мьютекса: записать в его слот текущую эпоху
+    static void retire(int key, int quantum_index);  // отложить освобождение памяти переданного кванта до смены эпохи всеми потоками
+    static void reclaim_retired(int key);  // вернуть распределителю память, которую потоки вычислений больше не записывают
+    static bool is_leased(quantum_worker& quantum);  // квант получен недавно и ещё не передаётся следующему владельцу
+    static void serve_leases(std::vector<std::pair<int, int>>& leased);  // отправить кванты, аренда которых закончилась
+    static int start_get_info(int key, int quantum_index);  // асинхронно запросить квант, возвращает номер слота
+    static void finish_pending(int slot);  // завершить запрос, ответ каталога и квант по которому уже получены
+    static void complete_pending(int slot);  // дождаться завершения запроса
+    static void finish_ready_pending();  // дождаться завершения хотя бы одного запроса и завершить все запросы с пришедшими ответами и квантами
+    static void wait_pending(int key, int quantum_index);
+    static bool pin_quantum(int key, int quantum_index);  // закрепить квант, если он есть на процессе
+    static void release_view(int key, int quantum_index);  // открепить квант и выполнить отложенный запрос GET_DATA_RW
+    static void send_quantum(int key, int quantum_index, int to_rank, int tag);  // отправить квант в READ_WRITE режиме, мьютекс кванта захвачен
+    static void free_removed(int key, int quantum_index);  // освободить память вытесненного кванта, мьютекс кванта захвачен
+    static void send_set_info(int key, int quantum_index, int from_rank);  // уведомить каталог о готовности кванта
+    static void make_twin(int key, int quantum_index, int from_rank);  // сохранить копию кванта, полученного в WRITE_SHARED режиме от другого процесса
+    static void release_shared(int key, int quantum_index);  // отправить владельцу изменённые элементы кванта и освободить копию и её двойник
+    // разослать кванты владельцев owners[i] кванта l + i процессам, запросившим копии по данным infos смены режима
+    static void replicate(int key, int quantum_index_l, const std::vector<int>& owners, const std::vector<int>& infos);
+    template <class T> static T update_element(int key, long long index_of_element, T value, int op, bool is_fetch);  // accumulate и fetch_and_op
+    template <class T> static void apply_op(int op, char* elem, const char* value);
+    static bool apply_local(int key, int quantum_index, int offset, int op, const char* value, char* old_value);  // применить операцию, если квант на процессе
+    static void post_accumulate(int key, int quantum_index, int offset, int op, const char* value, bool is_fetch);  // добавить запись с данными в посылку каталогу
+    static int get_payload_records(const int* record);  // число записей с данными, следующих за записью ACCUMULATE, FETCH_AND_OP и DIFF
+    static void apply_accumulate(int key, const int* record, std::vector<int>& acks);  // выполнить запись ACCUMULATE, FETCH_AND_OP или DIFF, мьютекс кванта захвачен
+    static void send_accumulate_acks(std::vector<int>& acks);  // сообщить процессам число выполненных ACCUMULATE
+    // записи накапливаются и отправляются одной посылкой каждому получателю; посылки отправляются
+    // перед любым блокирующим ожиданием и перед возвратом управления пользователю, кроме SET_INFO и ACCUMULATE:
+    // их никто не ждёт (ACCUMULATE - до wait_accumulates), и они уходят при следующей отправке посылок
+    static void post_request(int home, std::initializer_list<int> record);  // добавить запись в посылку части каталога home
+    static void flush_requests();
+    static void post_helper_request(int to_rank, std::initializer_list<int> record);  // добавить запись в посылку вспомогательному потоку to_rank
+    static void flush_helper_requests();
+    static void count_messages(const std::vector<int>& message, std::vector<long long>& records, std::vector<long long>& messages);
+    static void write_messages_statistics();
+    static int handle_get_info(int key, int quantum_index, int requesting_process, int data_tag, int& slot);  // обработка запроса кванта каталогом
+    static void handle_set_info(int key, int quantum_index, int sender_process, int requesting_process, int slot);  // обработка уведомления о готовности кванта каталогом
     static int get_owner(int key, int quantum_index, int requesting_process);  // получить номер процесса, хранящего квант в текущий момент времени
     static void remove_owner(int key, int removing_quantum_index, int process);  // удалить процесс из структуры данных с номерами процессов, хранящих данный квант
-    static void collect_statistic_worker(int key, int quantum_index);
+    static void collect_statistic_worker(int key, int quantum_index);  // перенести обращения без мьютекса в последний элемент cnt
     friend void worker_helper_thread();  // функция, выполняемая вспомогательными потоками процессов-рабочих
-    friend void master_helper_thread();  // функция, выполняемая вспомогательным потоком процесса-мастера
+    friend void master_helper_thread(int thread_index);  // функция, выполняемая потоками, обслуживающими часть каталога
+    template <class T> friend class data_future;
+    template <class T> friend class quantum_view;
 };
 
 template <class T>
-int memory_manager::create_object(int number_of_elements, int quantum_size, int cache_size) {
-    memory_line_common* line;
-    int num_of_quantums = (number_of_elements + quantum_size - 1) / quantum_size;
-    if (rank == 0) {
-        line = new memory_line_master;
-        auto line_master = dynamic_cast<memory_line_master*>(line);
-        line_master->quantums.resize(num_of_quantums, quantum_master(size));
-        line_master->wait_locks.resize(num_of_quantums);
-        line_master->wait_quantums.resize(num_of_quantums);
-    } else {
-        line = new memory_line_worker;
-        auto line_worker = dynamic_cast<memory_line_worker*>(line);
-        line_worker->quantums.resize(num_of_quantums);
-        line_worker->allocator.set_quantum_size(quantum_size, sizeof(T));
-        line_worker->cache = memory_cache(cache_size, num_of_quantums, workers_comm);
-        line_worker->type = get_mpi_type<T>();
-        line_worker->size_of = sizeof(T);
+int memory_manager::create_object(long long number_of_elements, int quantum_size, int cache_size, const distribution& dist, int cache_policy) {
+    // идентификатор уничтоженной структуры используется снова; create_object и destroy_object вызываются всеми процессами
+    // в одном порядке, поэтому идентификаторы на всех процессах совпадают
+    int key = int(std::find(memory.begin(), memory.end(), nullptr) - memory.begin());
+    auto* line = new memory_line_worker;  // процесс 0 не хранит кванты, в его memory_line_worker заполняются только размеры
+    CHECK(number_of_elements >= 0 && quantum_size > 0, STATUS_ERR_OUT_OF_BOUNDS);
+    // номера квантов передаются в посылках как int
+    CHECK((number_of_elements + quantum_size - 1) / quantum_size <= INT_MAX, STATUS_ERR_OUT_OF_BOUNDS);
+    int num_of_quantums = int((number_of_elements + quantum_size - 1) / quantum_size);
+    // каталог делится между всеми процессами на непрерывные диапазоны квантов
+    auto* line_master = new memory_line_master;
+    line_master->first_quantum_index = get_first_quantum(num_of_quantums, rank);
+    int directory_size = get_first_quantum(num_of_quantums, rank + 1) - line_master->first_quantum_index;
+    line_master->quantums.resize(directory_size, quantum_master(size));
+    line_master->wait_locks.resize(directory_size);
+    line_master->changed_mode_procs.assign(worker_size, false);
+    line_master->quantum_size = quantum_size;
+    line_master->logical_size = number_of_elements;
+    line_master->size_of = sizeof(T);
+    if (rank != 0) {
+        line->quantums.resize(num_of_quantums);
+        line->allocator.set_quantum_size(quantum_size, sizeof(T));
+        if (cache_budget > 0) {  // кеш структуры может занять весь бюджет
+            cache_size = int(std::max(1LL, std::min((long long)num_of_quantums, cache_budget / ((long long)quantum_size * (long long)sizeof(T)))));
+        }
+        line->cache = memory_cache(cache_size, num_of_quantums, workers_comm, cache_policy);
+        line->type = get_mpi_type<T>();
+        line->apply_op = &memory_manager::apply_op<T>;
+#if (ENABLE_RMA_READ_ONLY)
+        if (worker_size > 1) {  // с одним рабочим все кванты локальны
+            MPI_Win_create_dynamic(MPI_INFO_NULL, workers_comm, &line->win);
+            line->allocator.attach(line->win);
+            MPI_Aint slabs_address = line->allocator.get_slabs_address();
+            line->slab_tables.resize(worker_size);
+            MPI_Allgather(&slabs_address, 1, MPI_AINT, line->slab_tables.data(), 1, MPI_AINT, workers_comm);
+            line->remote_slabs.resize(worker_size);
+            MPI_Win_lock_all(0, line->win);
+        }
+#endif
     }
     line->quantum_size = quantum_size;
     line->logical_size = number_of_elements;
-    memory.emplace_back(line);
+    line->size_of = sizeof(T);
+    line->dist = dist;
+    if (dist.kind != NO_DISTRIBUTION) {
+        for (int i = 0; i < directory_size; ++i) {
+            int owner = dist.get_owner(line_master->first_quantum_index + i, num_of_quantums, worker_size);
+            CHECK(owner > 0 && owner < size, STATUS_ERR_WRONG_RANK);
+            line_master->quantums[i].owners.push_back(owner);
+            line_master->quantums[i].quantum_ready = true;
+        }
+        for (int i = 0; rank != 0 && i < num_of_quantums; ++i) {
+            if (dist.get_owner(i, num_of_quantums, worker_size) == rank) {
+                auto& quantum = line->quantums[i];
+                quantum.quantum = line->allocator.alloc();
+                std::memset(quantum.quantum, 0, size_t(quantum_size) * sizeof(T));
+#if (ENABLE_STATISTICS_COLLECTION)
+    #if (ENABLE_STATISTICS_QUANTUMS_CNT_WORKERS)
+                quantum.cnt.push_back(0);
+                quantum.modes.push_back(READ_WRITE);
+    #endif
+#endif
+            }
+        }
+    }
+    if (key == (int)memory.size()) {
+        memory.emplace_back(line);
+        directory.emplace_back(line_master);
+    } else {
+        memory[key] = line;
+        directory[key] = line_master;
+    }
     MPI_Barrier(MPI_COMM_WORLD);
-    return int(memory.size()) - 1;
+    return key;
 }
 
 template <class T>
-int memory_manager::create_object(int count, const int* blocklens, const MPI_Aint* indices, const MPI_Datatype* types, int number_of_elements, int quantum_size, int cache_size) {
-    int key = memory_manager::create_object<T>(number_of_elements, quantum_size, cache_size);
+int memory_manager::create_object(int count, const int* blocklens, const MPI_Aint* indices, const MPI_Datatype* types, long long number_of_elements, int quantum_size, int cache_size,
+                                  const distribution& dist, int cache_policy) {
+    int key = memory_manager::create_object<T>(number_of_elements, quantum_size, cache_size, dist, cache_policy);
     if (rank) {
-        dynamic_cast<memory_line_worker*>(memory[key])->type = create_mpi_type<T>(count, blocklens, indices, types);
+        memory[key]->type = create_mpi_type<T>(count, blocklens, indices, types);
     }
     return key;
 }
 
+inline void memory_manager::quiescent() {
+    if (thread_epoch != nullptr) {
+        thread_epoch->store(global_epoch.load(std::memory_order_acquire), std::memory_order_release);
+    }
+}
+
+inline memory_manager::offline_scope::offline_scope() {
+    if (thread_epoch != nullptr) {
+        thread_epoch->store(OFFLINE_EPOCH, std::memory_order_release);
+    }
+}
+
+inline memory_manager::offline_scope::~offline_scope() {
+    if (thread_epoch != nullptr) {
+        thread_epoch->store(global_epoch.load());
+        std::atomic_thread_fence(std::memory_order_seq_cst);  // парный барьер - в reclaim_retired, как в register_thread
+    }
+}
+
+inline void memory_manager::count_hit(quantum_worker& quantum) {
+#if (LEASE_TIME_US > 0 && LEASE_ACCESSES > 0)
+    quantum.lease_accesses->store(quantum.lease_accesses->load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+#endif
+#if (ENABLE_STATISTICS_COLLECTION)
+    #if (ENABLE_STATISTICS_QUANTUMS_CNT_WORKERS)
+    // счётчик увеличивается без атомарной операции чтения-записи: одновременные обращения нескольких потоков могут быть учтены не все
+    quantum.hits->store(quantum.hits->load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    #endif
+#endif
+}
+
 template <class T>
-T memory_manager::get_data(int key, int index_of_element) {
+T memory_manager::get_data(int key, long long index_of_element) {
     CHECK(key >= 0 && key < (int)memory_manager::memory.size(), STATUS_ERR_OUT_OF_BOUNDS);
-    auto* memory = dynamic_cast<memory_line_worker*>(memory_manager::memory[key]);
+    auto* memory = memory_manager::memory[key];
     int quantum_index = get_quantum_index(key, index_of_element);
     auto& quantum = memory->quantums[quantum_index].quantum;
-    CHECK(index_of_element >= 0 && index_of_element < (int)memory->logical_size, STATUS_ERR_OUT_OF_BOUNDS);
+    CHECK(index_of_element >= 0 && index_of_element < memory->logical_size, STATUS_ERR_OUT_OF_BOUNDS);
     CHECK(quantum_index >= 0 && quantum_index < (int)memory->quantums.size(), STATUS_ERR_OUT_OF_BOUNDS);
 
+    // квант на процессе: элемент читается без мьютекса, чтение действительно, если квант за это время не освобождался
+    unsigned version = memory->quantums[quantum_index].version->load(std::memory_order_acquire);
+    if (!(version & 3) && !memory->quantums[quantum_index].is_mode_changed && quantum != nullptr) {
+        T elem = (reinterpret_cast<T*>(quantum))[index_of_element % memory->quantum_size];
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (memory->quantums[quantum_index].version->load(std::memory_order_relaxed) == version) {
+            count_hit(memory->quantums[quantum_index]);
+            if (memory->quantums[quantum_index].mode == READ_ONLY) {
+                memory->cache.hit(quantum_index);  // очереди кеша изменяются под compute_mutex при следующем вытеснении
+            }
+            quiescent();
+            return elem;
+        }
+    }
+
+    // промахи потоков процесса обрабатываются по одному: поток, ждавший получения кванта другим потоком, находит его на процессе
+    offline_scope offline;
+    std::lock_guard<std::recursive_mutex> lock(compute_mutex);
+    if (memory->quantums[quantum_index].pending != -1) {  // квант запрошен асинхронно
+        complete_pending(memory->quantums[quantum_index].pending);
+    }
     memory->quantums[quantum_index].mutex->lock();
     if (!memory->quantums[quantum_index].is_mode_changed) {  // не было изменения режима? (данные актуальны?)
         if (quantum != nullptr) {  // на данном процессе есть квант?
             T elem = (reinterpret_cast<T*>(quantum))[index_of_element % memory->quantum_size];
             memory->quantums[quantum_index].mutex->unlock();
+            if (memory->quantums[quantum_index].mode == READ_ONLY) {
+                memory->cache.hit(quantum_index);
+            }
 #ifdef ENABLE_STATISTICS_COLLECTION
     #if (ENABLE_STATISTICS_QUANTUMS_CNT_WORKERS)
             ++memory->quantums[quantum_index].cnt.back();
     #endif
 #endif
-            return elem;  // элемент возвращается без обращения к мастеру
+            return elem;  // элемент возвращается без обращения к каталогу
         }
     }
     memory->quantums[quantum_index].mutex->unlock();
 
 #ifdef ENABLE_STATISTICS_COLLECTION
     #if (ENABLE_STATISTICS_QUANTUMS_CNT_WORKERS)
+    collect_statistic_worker(key, quantum_index);
     memory->quantums[quantum_index].cnt.push_back(1);
     memory->quantums[quantum_index].modes.push_back(memory->quantums[quantum_index].mode);
     #endif
 #endif
 
     // работа с кешем
-    if (memory->quantums[quantum_index].is_mode_changed && memory->quantums[quantum_index].mode == READ_WRITE) {
+    if (memory->quantums[quantum_index].is_mode_changed && memory->quantums[quantum_index].mode != READ_ONLY) {
         if (memory->cache.is_contain(quantum_index)) {
             memory->cache.delete_elem(quantum_index);
         }
@@ -191,47 +548,53 @@ T memory_manager::get_data(int key, int index_of_element) {
 
     int removing_quantum_index = -1;
     if (memory->quantums[quantum_index].mode == READ_ONLY) {
-        removing_quantum_index = memory->cache.add(quantum_index);
+        removing_quantum_index = cache_add(key, quantum_index);
     }
+    reserve_quantum(key, quantum_index);
 
-    int request[4] = {GET_INFO, key, quantum_index, removing_quantum_index};  // обращение к мастеру с целью получить квант
-    MPI_Send(request, 4, MPI_INT, 0, SEND_DATA_TO_MASTER_HELPER, MPI_COMM_WORLD);
-    int to_rank = -2;
-    MPI_Status status;
-    MPI_Recv(&to_rank, 1, MPI_INT, 0, GET_INFO_FROM_MASTER_HELPER, MPI_COMM_WORLD, &status);  // получение ответа от мастера
-    memory->quantums[quantum_index].is_mode_changed = false;
-
-    if (memory->quantums[quantum_index].mode == READ_ONLY && to_rank == rank) {  // если read_only_mode и данные уже у процесса,
-                                                 // ответ мастеру о том, что данные готовы, отправлять не нужно
-        CHECK(quantum != nullptr, STATUS_ERR_NULLPTR);
-        return (reinterpret_cast<T*>(quantum))[index_of_element % memory->quantum_size];
-    }
-    if (to_rank != rank) {  // если данные не у текущего процесса, инициируется передача данных от указанного мастером процесса
-        if (quantum == nullptr) {
-            quantum = memory->allocator.alloc();
-        }
-        CHECK(to_rank > 0 && to_rank < size, STATUS_ERR_WRONG_RANK);
-        CHECK(quantum != nullptr, STATUS_ERR_NULLPTR);
-        MPI_Recv(quantum, memory->quantum_size, memory->type, to_rank, GET_DATA_FROM_HELPER, MPI_COMM_WORLD, &status);
-    }
-    request[0] = SET_INFO;
-    request[3] = (to_rank != rank) ? to_rank : -1;
+    int to_rank = get_info(key, quantum_index, removing_quantum_index);  // обращение к каталогу и приём кванта
+    reset_mode_changed(key, quantum_index);
+    make_twin(key, quantum_index, to_rank);
     CHECK(quantum != nullptr, STATUS_ERR_NULLPTR);
     T elem = (reinterpret_cast<T*>(quantum))[index_of_element % memory->quantum_size];
-    MPI_Send(request, 4, MPI_INT, 0, SEND_DATA_TO_MASTER_HELPER, MPI_COMM_WORLD);  // уведомление мастера о том, что данные готовы для передачи другим процессам
-
+    set_received(key, quantum_index);  // элемент прочитан до того, как отложенный запрос GET_DATA_RW заберёт квант
+    // если read_only_mode и данные уже у процесса, ответ каталогу о том, что данные готовы, отправлять не нужно
+    if (memory->quantums[quantum_index].mode != READ_ONLY || to_rank != rank) {
+        send_set_info(key, quantum_index, (to_rank != rank) ? to_rank : -1);  // уведомление каталога уходит со следующей посылкой
+    }
     return elem;
 }
 
 template <class T>
-void memory_manager::set_data(int key, int index_of_element, T value) {
+void memory_manager::set_data(int key, long long index_of_element, T value) {
     CHECK(key >= 0 && key < (int)memory_manager::memory.size(), STATUS_ERR_OUT_OF_BOUNDS  );
-    auto* memory = dynamic_cast<memory_line_worker*>(memory_manager::memory[key]);
+    auto* memory = memory_manager::memory[key];
     int quantum_index = get_quantum_index(key, index_of_element);
-    CHECK(memory->quantums[quantum_index].mode == READ_WRITE, STATUS_ERR_ILLEGAL_WRITE);  // запись в READ_ONLY режиме запрещена
-    CHECK(index_of_element >= 0 && index_of_element < (int)memory->logical_size, STATUS_ERR_OUT_OF_BOUNDS);
+    CHECK(memory->quantums[quantum_index].mode != READ_ONLY, STATUS_ERR_ILLEGAL_WRITE);  // запись в READ_ONLY режиме запрещена
+    CHECK(index_of_element >= 0 && index_of_element < memory->logical_size, STATUS_ERR_OUT_OF_BOUNDS);
     CHECK(quantum_index >= 0 && quantum_index < (int)memory->quantums.size(), STATUS_ERR_OUT_OF_BOUNDS);
     auto& quantum = memory->quantums[quantum_index].quantum;
+    // квант на процессе: элемент записывается без мьютекса. Если вспомогательный поток начал передачу кванта,
+    // запись могла не попасть в отправленные данные и повторяется ниже на новом месте кванта. Память переданного кванта
+    // не выдаётся снова, пока поток не перейдёт в новую эпоху, поэтому запись не попадает в чужой квант
+    if (thread_epoch == nullptr) {
+        register_thread();
+    }
+    unsigned version = memory->quantums[quantum_index].version->load(std::memory_order_acquire);
+    if (!(version & 3) && !memory->quantums[quantum_index].is_mode_changed && quantum != nullptr) {
+        (reinterpret_cast<T*>(quantum))[index_of_element % memory->quantum_size] = value;
+        std::atomic_thread_fence(std::memory_order_seq_cst);  // парный барьер - в send_quantum после увеличения версии
+        if (memory->quantums[quantum_index].version->load(std::memory_order_relaxed) == version) {
+            count_hit(memory->quantums[quantum_index]);
+            quiescent();
+            return;
+        }
+    }
+    offline_scope offline;
+    std::lock_guard<std::recursive_mutex> lock(compute_mutex);
+    if (memory->quantums[quantum_index].pending != -1) {  // квант запрошен асинхронно
+        complete_pending(memory->quantums[quantum_index].pending);
+    }
     memory->quantums[quantum_index].mutex->lock();
     if (!memory->quantums[quantum_index].is_mode_changed) {
         if (quantum != nullptr) {
@@ -249,35 +612,251 @@ void memory_manager::set_data(int key, int index_of_element, T value) {
     memory->quantums[quantum_index].mutex->unlock();
 #ifdef ENABLE_STATISTICS_COLLECTION
     #if (ENABLE_STATISTICS_QUANTUMS_CNT_WORKERS)
+    collect_statistic_worker(key, quantum_index);
     memory->quantums[quantum_index].cnt.push_back(1);
     memory->quantums[quantum_index].modes.push_back(memory->quantums[quantum_index].mode);
     #endif
 #endif
-    int request[4] = {GET_INFO, key, quantum_index, -1};
-    MPI_Send(request, 4, MPI_INT, 0, SEND_DATA_TO_MASTER_HELPER, MPI_COMM_WORLD);  // обращение к мастеру с целью получить квант
-    int to_rank = -2;
-    MPI_Status status;
-    MPI_Recv(&to_rank, 1, MPI_INT, 0, GET_INFO_FROM_MASTER_HELPER, MPI_COMM_WORLD, &status);  // получение ответа от мастера
-    memory->quantums[quantum_index].is_mode_changed = false;
-    if (quantum == nullptr) {
-        quantum = memory->allocator.alloc();
-    }
-    if (to_rank != rank) {  // если данные не у текущего процесса, инициируется передача данных от указанного мастером процесса
-        CHECK(to_rank > 0 && to_rank < size, STATUS_ERR_WRONG_RANK);
-        MPI_Recv(quantum, memory->quantum_size, memory->type, to_rank, GET_DATA_FROM_HELPER, MPI_COMM_WORLD, &status);
-    }
-    request[0] = SET_INFO;
-    request[3] = (to_rank != rank) ? to_rank : -1;
+    reserve_quantum(key, quantum_index);
+    int to_rank = get_info(key, quantum_index, -1);  // обращение к каталогу и приём кванта
+    reset_mode_changed(key, quantum_index);
+    make_twin(key, quantum_index, to_rank);  // до записи: двойник хранит квант в том виде, в каком его прислал владелец
     (reinterpret_cast<T*>(quantum))[index_of_element % memory->quantum_size] = value;
-    MPI_Send(request, 4, MPI_INT, 0, SEND_DATA_TO_MASTER_HELPER, MPI_COMM_WORLD);  // уведомление мастера о том, что данные готовы для передачи другим процессам
+    set_received(key, quantum_index);
+    send_set_info(key, quantum_index, (to_rank != rank) ? to_rank : -1);  // уведомление каталога уходит со следующей посылкой
+}
+
+template <class T>
+void memory_manager::accumulate(int key, long long index_of_element, T value, int op) {
+    update_element<T>(key, index_of_element, value, op, false);
+}
+
+template <class T>
+T memory_manager::fetch_and_op(int key, long long index_of_element, T value, int op) {
+    return update_element<T>(key, index_of_element, value, op, true);
+}
 
+template <class T>
+T memory_manager::update_element(int key, long long index_of_element, T value, int op, bool is_fetch) {
+    CHECK(key >= 0 && key < (int)memory_manager::memory.size(), STATUS_ERR_OUT_OF_BOUNDS);
+    auto* memory = memory_manager::memory[key];
+    CHECK(index_of_element >= 0 && index_of_element < memory->logical_size, STATUS_ERR_OUT_OF_BOUNDS);
+    int quantum_index = get_quantum_index(key, index_of_element);
+    // accumulate выполняется владельцем кванта, в WRITE_SHARED режиме изменения копий сливаются только при смене режима
+    CHECK(memory->quantums[quantum_index].mode == READ_WRITE, STATUS_ERR_ILLEGAL_WRITE);
+    CHECK(op >= 0 && op < NUMBER_OF_ACCUMULATE_OPS + number_of_user_ops, STATUS_ERR_OUT_OF_BOUNDS);
+    // встроенные операции, кроме OP_REPLACE, определены только для арифметических типов, побитовые - только для целых
+    CHECK(op >= NUMBER_OF_ACCUMULATE_OPS || op == OP_REPLACE || (std::is_arithmetic<T>::value && (op < OP_BAND || std::is_integral<T>::value)),
+          STATUS_ERR_UNKNOWN);
+    std::lock_guard<std::recursive_mutex> lock(compute_mutex);
+    if (memory->quantums[quantum_index].pending != -1) {  // квант запрошен асинхронно
+        complete_pending(memory->quantums[quantum_index].pending);
+    }
+    // после смены режима каталог ещё не знает владельца кванта, квант забирается на процесс, как при записи
+    if (memory->quantums[quantum_index].is_mode_changed) {
+        get_data<T>(key, index_of_element);
+    }
+    T old_value = T();
+    int offset = int(index_of_element % memory->quantum_size);
+    if (apply_local(key, quantum_index, offset, op, reinterpret_cast<const char*>(&value), reinterpret_cast<char*>(&old_value))) {
+        return old_value;
+    }
+    post_accumulate(key, quantum_index, offset, op, reinterpret_cast<const char*>(&value), is_fetch);
+    if (is_fetch) {
+        flush_requests();
+        MPI_Status status;
+        MPI_Recv(&old_value, sizeof(T), MPI_BYTE, MPI_ANY_SOURCE, GET_FETCH_RESULT_FROM_HELPER, MPI_COMM_WORLD, &status);  // ответ владельца кванта
+    }
+    return old_value;
+}
+
+template <class T>
+void memory_manager::apply_op(int op, char* elem, const char* value) {
+    if (op >= NUMBER_OF_ACCUMULATE_OPS) {
+        user_ops[op - NUMBER_OF_ACCUMULATE_OPS](elem, value);
+        return;
+    }
+    T a, b;  // данные в записях посылок не выровнены
+    std::memcpy(&a, elem, sizeof(T));
+    std::memcpy(&b, value, sizeof(T));
+    if (op == OP_REPLACE) {
+        a = b;
+    } else {
+        CHECK(apply_arithmetic_op(op, a, b, std::is_arithmetic<T>()), STATUS_ERR_UNKNOWN);
+    }
+    std::memcpy(elem, &a, sizeof(T));
+}
+
+template <class T, class F>
+int memory_manager::create_op(F func) {
+    CHECK(number_of_user_ops < MAX_USER_OPS, STATUS_ERR_OUT_OF_BOUNDS);
+    user_ops[number_of_user_ops] = [func](char* elem, const char* value) {
+        T a, b;
+        std::memcpy(&a, elem, sizeof(T));
+        std::memcpy(&b, value, sizeof(T));
+        a = func(a, b);
+        std::memcpy(elem, &a, sizeof(T));
+    };
+    MPI_Barrier(MPI_COMM_WORLD);  // операция зарегистрирована на всех процессах до того, как её запишут в посылку
+    return NUMBER_OF_ACCUMULATE_OPS + number_of_user_ops++;
+}
+
+template <class T>
+data_future<T> memory_manager::get_data_async(int key, long long index_of_element) {
+    CHECK(key >= 0 && key < (int)memory_manager::memory.size(), STATUS_ERR_OUT_OF_BOUNDS);
+    auto* memory = memory_manager::memory[key];
+    int quantum_index = get_quantum_index(key, index_of_element);
+    CHECK(index_of_element >= 0 && index_of_element < memory->logical_size, STATUS_ERR_OUT_OF_BOUNDS);
+    CHECK(quantum_index >= 0 && quantum_index < (int)memory->quantums.size(), STATUS_ERR_OUT_OF_BOUNDS);
+    auto& quantum = memory->quantums[quantum_index];
+    std::lock_guard<std::recursive_mutex> lock(compute_mutex);
+    quantum.mutex->lock();
+    bool is_present = !quantum.is_mode_changed && quantum.quantum != nullptr;
+    quantum.mutex->unlock();
+    if (!is_present && quantum.pending == -1) {  // квант отсутствует и ещё не запрошен
+        start_get_info(key, quantum_index);
+        flush_requests();
+    }
+    return data_future<T>(key, index_of_element);
+}
+
+template <class T>
+data_future<T> memory_manager::set_data_async(int key, long long index_of_element, T value) {
+    CHECK(key >= 0 && key < (int)memory_manager::memory.size(), STATUS_ERR_OUT_OF_BOUNDS);
+    auto* memory = memory_manager::memory[key];
+    int quantum_index = get_quantum_index(key, index_of_element);
+    CHECK(index_of_element >= 0 && index_of_element < memory->logical_size, STATUS_ERR_OUT_OF_BOUNDS);
+    CHECK(quantum_index >= 0 && quantum_index < (int)memory->quantums.size(), STATUS_ERR_OUT_OF_BOUNDS);
+    auto& quantum = memory->quantums[quantum_index];
+    CHECK(quantum.mode != READ_ONLY, STATUS_ERR_ILLEGAL_WRITE);  // запись в READ_ONLY режиме запрещена
+    std::lock_guard<std::recursive_mutex> lock(compute_mutex);
+    if (quantum.pending == -1) {
+        quantum.mutex->lock();
+        if (!quantum.is_mode_changed && quantum.quantum != nullptr) {
+            (reinterpret_cast<T*>(quantum.quantum))[index_of_element % memory->quantum_size] = value;
+            quantum.mutex->unlock();
+#ifdef ENABLE_STATISTICS_COLLECTION
+    #if (ENABLE_STATISTICS_QUANTUMS_CNT_WORKERS)
+            ++quantum.cnt.back();
+    #endif
+#endif
+            return data_future<T>(key, index_of_element);
+        }
+        quantum.mutex->unlock();
+        start_get_info(key, quantum_index);
+        flush_requests();
+    }
+    const char* bytes = reinterpret_cast<const char*>(&value);
+    pending[quantum.pending].writes.emplace_back(int((index_of_element % memory->quantum_size) * sizeof(T)), std::vector<char>(bytes, bytes + sizeof(T)));
+    return data_future<T>(key, index_of_element);
+}
+
+template <class T>
+void data_future<T>::wait() {
+    memory_manager::wait_pending(key, memory_manager::get_quantum_index(key, index_of_element));
+}
+
+template <class T>
+T data_future<T>::get() {
+    return memory_manager::get_data<T>(key, index_of_element);  // незавершённый запрос кванта завершается внутри get_data
+}
+
+template <class T>
+quantum_view<T> memory_manager::acquire_view(int key, int quantum_index, mods mode) {
+    CHECK(key >= 0 && key < (int)memory_manager::memory.size(), STATUS_ERR_OUT_OF_BOUNDS);
+    auto* memory = memory_manager::memory[key];
+    CHECK(quantum_index >= 0 && quantum_index < (int)memory->quantums.size(), STATUS_ERR_OUT_OF_BOUNDS);
+    CHECK(memory->size_of == sizeof(T), STATUS_ERR_UNKNOWN);
+    auto& quantum = memory->quantums[quantum_index];
+    CHECK(mode == READ_ONLY || quantum.mode != READ_ONLY, STATUS_ERR_ILLEGAL_WRITE);
+    // между получением кванта и закреплением его может запросить другой процесс, тогда квант запрашивается снова
+    do {
+        get_data<T>(key, quantum_index * memory->quantum_size);
+    } while (!pin_quantum(key, quantum_index));
+    int length = int(std::min<long long>(memory->quantum_size, memory->logical_size - (long long)quantum_index * memory->quantum_size));
+    return quantum_view<T>(key, quantum_index, reinterpret_cast<T*>(quantum.quantum), length);
+}
+
+template <class T, class F>
+void memory_manager::parallel_for(int key, int num_threads, F func) {
+    CHECK(key >= 0 && key < (int)memory_manager::memory.size(), STATUS_ERR_OUT_OF_BOUNDS);
+    CHECK(num_threads > 0, STATUS_ERR_OUT_OF_BOUNDS);
+    auto* memory = memory_manager::memory[key];
+    std::vector<int> local_quantums;
+    {
+        std::lock_guard<std::recursive_mutex> lock(compute_mutex);
+        for (int i = 0; i < (int)memory->quantums.size(); ++i) {
+            auto& quantum = memory->quantums[i];
+            quantum.mutex->lock();
+            if (!quantum.is_mode_changed && quantum.quantum != nullptr && quantum.pending == -1) {
+                local_quantums.push_back(i);
+            }
+            quantum.mutex->unlock();
+        }
+    }
+    // каждый квант закрепляется на время обработки; квант, переданный другому процессу после составления списка, запрашивается снова
+    std::vector<std::thread> threads;
+    for (int t = 0; t < num_threads; ++t) {
+        threads.emplace_back([&, t]() {
+            for (int i = t; i < (int)local_quantums.size(); i += num_threads) {
+                int quantum_index = local_quantums[i];
+                quantum_view<T> view = acquire_view<T>(key, quantum_index, mods(memory->quantums[quantum_index].mode));
+                for (int j = 0; j < view.size(); ++j) {
+                    func((long long)quantum_index * memory->quantum_size + j, view[j]);
+                }
+            }
+        });
+    }
+    for (auto& thread: threads) {
+        thread.join();
+    }
+}
+
+template <class T>
+quantum_view<T>::quantum_view(quantum_view&& other): key(other.key), quantum_index(other.quantum_index), ptr(other.ptr), length(other.length) {
+    other.ptr = nullptr;
+}
+
+template <class T>
+quantum_view<T>& quantum_view<T>::operator=(quantum_view&& other) {
+    if (this != &other) {
+        release();
+        key = other.key;
+        quantum_index = other.quantum_index;
+        ptr = other.ptr;
+        length = other.length;
+        other.ptr = nullptr;
+    }
+    return *this;
+}
+
+template <class T>
+void quantum_view<T>::release() {
+    if (ptr != nullptr) {
+        memory_manager::release_view(key, quantum_index);
+        ptr = nullptr;
+    }
+}
+
+template <class T>
+void memory_manager::get_range(int key, long long l, long long r, T* out) {
+    CHECK(key >= 0 && key < (int)memory_manager::memory.size(), STATUS_ERR_OUT_OF_BOUNDS);
+    CHECK(memory_manager::memory[key]->size_of == sizeof(T), STATUS_ERR_UNKNOWN);
+    range_access(key, l, r, reinterpret_cast<char*>(out), false);
+}
+
+template <class T>
+void memory_manager::set_range(int key, long long l, long long r, const T* in) {
+    CHECK(key >= 0 && key < (int)memory_manager::memory.size(), STATUS_ERR_OUT_OF_BOUNDS);
+    CHECK(memory_manager::memory[key]->size_of == sizeof(T), STATUS_ERR_UNKNOWN);
+    range_access(key, l, r, reinterpret_cast<char*>(const_cast<T*>(in)), true);
 }
 
 template <class T>
-void memory_manager::read(int key, const std::string& path, int number_of_elements) {
+void memory_manager::read(int key, const std::string& path, long long number_of_elements) {
     auto* memory = memory_manager::memory[key];
-    int num_of_quantums = (number_of_elements + memory->quantum_size - 1) / memory->quantum_size;
-    int offset = 0;
+    int num_of_quantums = int((number_of_elements + memory->quantum_size - 1) / memory->quantum_size);
+    long long offset = 0;
     for (int w_rank = 0; w_rank < worker_size; ++w_rank) {
         int quantum_portion = num_of_quantums / worker_size + (w_rank < num_of_quantums % worker_size?1:0);
         if (quantum_portion == 0)
@@ -286,24 +865,24 @@ void memory_manager::read(int key, const std::string& path, int number_of_elemen
             std::ifstream fs(path, std::ios::in | std::ios::binary);
             fs.seekg(offset * sizeof(int));
             T data;
-            for (int i = 0; i < std::min(quantum_portion * memory->quantum_size, number_of_elements); ++i) {
-                int logical_index = offset + i;
+            for (long long i = 0; i < std::min((long long)quantum_portion * memory->quantum_size, number_of_elements); ++i) {
+                long long logical_index = offset + i;
                 fs.read((char*)&data, sizeof(data));
                 memory_manager::set_data<T>(key, logical_index, data);
             }
         }
-        offset += quantum_portion * memory->quantum_size;
+        offset += (long long)quantum_portion * memory->quantum_size;
     }
     MPI_Barrier(workers_comm);  // ???
 }
 
 template <class T>
-void memory_manager::read(int key, const std::string& path, int number_of_elements, int offset, int num_of_elem_proc) {
+void memory_manager::read(int key, const std::string& path, long long number_of_elements, long long offset, long long num_of_elem_proc) {
     std::ifstream fs(path, std::ios::in | std::ios::binary);
     fs.seekg(offset * sizeof(int));
     T data;
-    for (int i = 0; i < std::min(num_of_elem_proc, number_of_elements); ++i) {
-        int logical_index = offset + i;
+    for (long long i = 0; i < std::min(num_of_elem_proc, number_of_elements); ++i) {
+        long long logical_index = offset + i;
         fs.read((char*)&data, sizeof(data));
         memory_manager::set_data<T>(key, logical_index, data);
     }
@@ -8,53 +8,157 @@
 
 template<class T>
 class parallel_vector {
-    int key;  // идентификатор вектора в memory_manager
-    int size_vector;  // глобальный размер вектора
+    int key = -1;  // идентификатор вектора в memory_manager, -1 - вектор перемещён
+    long long size_vector;  // глобальный размер вектора
 public:
-    parallel_vector(const int& number_of_elems=DEFAULT_QUANTUM_SIZE, const int& quantum_size = DEFAULT_QUANTUM_SIZE, const int& cache_size = DEFAULT_CACHE_SIZE);
+    parallel_vector(const long long& number_of_elems=DEFAULT_QUANTUM_SIZE, const int& quantum_size = DEFAULT_QUANTUM_SIZE, const int& cache_size = DEFAULT_CACHE_SIZE,
+                    const distribution& dist = distribution(), const int& cache_policy = DEFAULT_CACHE_POLICY);
     parallel_vector(int count, const int* blocklens, const MPI_Aint* indices, const MPI_Datatype* types,
-                    const int& number_of_elems=DEFAULT_QUANTUM_SIZE, const int& quantum_size = DEFAULT_QUANTUM_SIZE, const int& cache_size = DEFAULT_CACHE_SIZE);
-    T get_elem(const int& index) const;  // получить элемент по глобальному индексу
-    void set_elem(const int& index, const T& value);  // сохранить элемент по глобальному индексу
+                    const long long& number_of_elems=DEFAULT_QUANTUM_SIZE, const int& quantum_size = DEFAULT_QUANTUM_SIZE, const int& cache_size = DEFAULT_CACHE_SIZE,
+                    const distribution& dist = distribution(), const int& cache_policy = DEFAULT_CACHE_POLICY);
+    // вектор владеет структурой memory_manager и уничтожает её в деструкторе: деструкторы, как и конструкторы, вызываются всеми процессами
+    // в одном порядке; после memory_manager::finalize деструктор ничего не делает
+    parallel_vector(const parallel_vector&) = delete;
+    parallel_vector& operator=(const parallel_vector&) = delete;
+    parallel_vector(parallel_vector&& other);
+    parallel_vector& operator=(parallel_vector&& other);  // прежняя структура вектора уничтожается
+    ~parallel_vector();
+    T get_elem(const long long& index) const;  // получить элемент по глобальному индексу
+    void set_elem(const long long& index, const T& value);  // сохранить элемент по глобальному индексу
+    data_future<T> get_elem_async(const long long& index) const;  // запросить элемент, не дожидаясь получения кванта
+    data_future<T> set_elem_async(const long long& index, const T& value);  // сохранить элемент по получении кванта
+    void accumulate(const long long& index, const T& value, int op);  // применить op к элементу на процессе-владельце, не перемещая квант
+    T fetch_and_op(const long long& index, const T& value, int op);  // то же, вернуть прежнее значение элемента
+    void get_range(long long l, long long r, T* out) const;  // получить элементы [l, r) в out
+    void set_range(long long l, long long r, const T* in);  // сохранить элементы [l, r) из in
+    void prefetch(long long l, long long r, bool is_claim = false) const;  // асинхронно запросить кванты с элементами [l, r), READ_WRITE кванты - только при is_claim
+    quantum_view<T> acquire_view(int quantum_index, mods mode) const;  // закрепить квант на процессе и получить доступ к нему по указателю
+    template <class F> void parallel_for(int num_threads, F func);  // применить func(index, elem) к элементам квантов, находящихся на процессе, в num_threads потоках
     void set_lock(int quantum_index);  // заблокировать квант
     void unset_lock(int quantum_index);  // разблокировать квант
-    int get_quantum(int index);  // по глобальному индексу получить номер кванта
+    int get_quantum(long long index);  // по глобальному индексу получить номер кванта
+    bool is_local(int quantum_index) const;  // размещён ли квант на данном процессе при создании
+    void local_range(long long& l, long long& r) const;  // элементы [l, r), размещённые на данном процессе при создании с распределением BLOCK
     int get_key() const;  // получить идентификатор вектора в memory_manager
     int get_num_quantums() const;
     int get_quantum_size() const;
-    int size() const;
-    void read(const std::string& path, int number_of_elements);
-    void read(const std::string& path, int number_of_elements, int offset, int num_elem_proc);
+    long long size() const;
+    void read(const std::string& path, long long number_of_elements);
+    void read(const std::string& path, long long number_of_elements, long long offset, long long num_elem_proc);
     void print(const std::string& path) const;
     void change_mode(int quantum_index, mods mode);
-    void change_mode(int quantum_index_l, int quantum_index_r, mods mode);
+    void change_mode(int quantum_index_l, int quantum_index_r, mods mode, bool is_replica = false);  // is_replica - получить копии квантов при смене на READ_ONLY
+    void change_mode_begin(int quantum_index_l, int quantum_index_r, mods mode, bool is_replica = false);  // начать смену режима, завершается change_mode_end
+    void change_mode_end();
     MPI_Datatype get_MPI_datatype() const;
 };
 
 template<class T>
-parallel_vector<T>::parallel_vector(const int& number_of_elems, const int& quantum_size, const int& cache_size) {
-    key = memory_manager::create_object<T>(number_of_elems, quantum_size, cache_size);
+parallel_vector<T>::parallel_vector(const long long& number_of_elems, const int& quantum_size, const int& cache_size, const distribution& dist,
+                                    const int& cache_policy) {
+    key = memory_manager::create_object<T>(number_of_elems, quantum_size, cache_size, dist, cache_policy);
     size_vector = number_of_elems;
 }
 template<class T>
 parallel_vector<T>::parallel_vector(int count, const int* blocklens, const MPI_Aint* indices, const MPI_Datatype* types,
-                                    const int& number_of_elems, const int& quantum_size, const int& cache_size) {
-    key = memory_manager::create_object<T>(count, blocklens, indices, types, number_of_elems, quantum_size, cache_size);
+                                    const long long& number_of_elems, const int& quantum_size, const int& cache_size, const distribution& dist,
+                                    const int& cache_policy) {
+    key = memory_manager::create_object<T>(count, blocklens, indices, types, number_of_elems, quantum_size, cache_size, dist, cache_policy);
     size_vector = number_of_elems;
 }
 
 template<class T>
-T parallel_vector<T>::get_elem(const int& index) const {
+parallel_vector<T>::parallel_vector(parallel_vector&& other): key(other.key), size_vector(other.size_vector) {
+    other.key = -1;
+}
+
+template<class T>
+parallel_vector<T>& parallel_vector<T>::operator=(parallel_vector&& other) {
+    if (this != &other) {
+        if (key != -1) {
+            memory_manager::destroy_object(key);
+        }
+        key = other.key;
+        size_vector = other.size_vector;
+        other.key = -1;
+    }
+    return *this;
+}
+
+template<class T>
+parallel_vector<T>::~parallel_vector() {
+    if (key != -1) {
+        memory_manager::destroy_object(key);
+    }
+}
+
+template<class T>
+T parallel_vector<T>::get_elem(const long long& index) const {
     CHECK(index >= 0 && index < size_vector, STATUS_ERR_OUT_OF_BOUNDS);
     return memory_manager::get_data<T>(key, index);
 }
 
 template<class T>
-void parallel_vector<T>::set_elem(const int& index, const T& value) {
+void parallel_vector<T>::set_elem(const long long& index, const T& value) {
     CHECK(index >= 0 && index < size_vector, STATUS_ERR_OUT_OF_BOUNDS);
     memory_manager::set_data<T>(key, index, value);
 }
 
+template<class T>
+data_future<T> parallel_vector<T>::get_elem_async(const long long& index) const {
+    CHECK(index >= 0 && index < size_vector, STATUS_ERR_OUT_OF_BOUNDS);
+    return memory_manager::get_data_async<T>(key, index);
+}
+
+template<class T>
+data_future<T> parallel_vector<T>::set_elem_async(const long long& index, const T& value) {
+    CHECK(index >= 0 && index < size_vector, STATUS_ERR_OUT_OF_BOUNDS);
+    return memory_manager::set_data_async<T>(key, index, value);
+}
+
+template<class T>
+void parallel_vector<T>::accumulate(const long long& index, const T& value, int op) {
+    CHECK(index >= 0 && index < size_vector, STATUS_ERR_OUT_OF_BOUNDS);
+    memory_manager::accumulate<T>(key, index, value, op);
+}
+
+template<class T>
+T parallel_vector<T>::fetch_and_op(const long long& index, const T& value, int op) {
+    CHECK(index >= 0 && index < size_vector, STATUS_ERR_OUT_OF_BOUNDS);
+    return memory_manager::fetch_and_op<T>(key, index, value, op);
+}
+
+template<class T>
+void parallel_vector<T>::get_range(long long l, long long r, T* out) const {
+    CHECK(l >= 0 && l <= r && r <= size_vector, STATUS_ERR_OUT_OF_BOUNDS);
+    memory_manager::get_range<T>(key, l, r, out);
+}
+
+template<class T>
+void parallel_vector<T>::set_range(long long l, long long r, const T* in) {
+    CHECK(l >= 0 && l <= r && r <= size_vector, STATUS_ERR_OUT_OF_BOUNDS);
+    memory_manager::set_range<T>(key, l, r, in);
+}
+
+template<class T>
+void parallel_vector<T>::prefetch(long long l, long long r, bool is_claim) const {
+    CHECK(l >= 0 && l <= r && r <= size_vector, STATUS_ERR_OUT_OF_BOUNDS);
+    if (l == r)
+        return;
+    memory_manager::prefetch(key, memory_manager::get_quantum_index(key, l), memory_manager::get_quantum_index(key, r - 1) + 1, is_claim);
+}
+
+template<class T>
+quantum_view<T> parallel_vector<T>::acquire_view(int quantum_index, mods mode) const {
+    return memory_manager::acquire_view<T>(key, quantum_index, mode);
+}
+
+template<class T>
+template<class F>
+void parallel_vector<T>::parallel_for(int num_threads, F func) {
+    memory_manager::parallel_for<T>(key, num_threads, func);
+}
+
 template<class T>
 void parallel_vector<T>::set_lock(int quantum_index) {
     memory_manager::set_lock(key, quantum_index);
@@ -66,10 +170,20 @@ void parallel_vector<T>::unset_lock(int quantum_index) {
 }
 
 template<class T>
-int parallel_vector<T>::get_quantum(int index) {
+int parallel_vector<T>::get_quantum(long long index) {
     return memory_manager::get_quantum_index(key, index);
 }
 
+template<class T>
+bool parallel_vector<T>::is_local(int quantum_index) const {
+    return memory_manager::get_initial_owner(key, quantum_index) == memory_manager::get_MPI_rank();
+}
+
+template<class T>
+void parallel_vector<T>::local_range(long long& l, long long& r) const {
+    memory_manager::get_local_range(key, l, r);
+}
+
 template<class T>
 int parallel_vector<T>::get_key() const {
     return key;
@@ -77,7 +191,7 @@ int parallel_vector<T>::get_key() const {
 
 template<class T>
 int parallel_vector<T>::get_num_quantums() const {
-    return (size_vector + memory_manager::get_quantum_size(key) - 1) / memory_manager::get_quantum_size(key);
+    return int((size_vector + memory_manager::get_quantum_size(key) - 1) / memory_manager::get_quantum_size(key));
 }
 
 template<class T>
@@ -86,17 +200,17 @@ int parallel_vector<T>::get_quantum_size() const {
 }
 
 template<class T>
-int parallel_vector<T>::size() const {
+long long parallel_vector<T>::size() const {
     return size_vector;
 }
 
 template<class T>
-void parallel_vector<T>::read(const std::string& path, int number_of_elements) {
+void parallel_vector<T>::read(const std::string& path, long long number_of_elements) {
     memory_manager::read<T>(key, path, number_of_elements);
 }
 
 template<class T>
-void parallel_vector<T>::read(const std::string& path, int number_of_elements, int offset, int num_elem_proc) {
+void parallel_vector<T>::read(const std::string& path, long long number_of_elements, long long offset, long long num_elem_proc) {
     memory_manager::read<T>(key, path, number_of_elements, offset, num_elem_proc);
 }
 
@@ -111,8 +225,18 @@ void parallel_vector<T>::change_mode(int quantum_index, mods mode) {
 }
 
 template<class T>
-void parallel_vector<T>::change_mode(int quantum_index_l, int quantum_index_r, mods mode) {
-    memory_manager::change_mode(key, quantum_index_l, quantum_index_r, mode);
+void parallel_vector<T>::change_mode(int quantum_index_l, int quantum_index_r, mods mode, bool is_replica) {
+    memory_manager::change_mode(key, quantum_index_l, quantum_index_r, mode, is_replica);
+}
+
+template <class T>
+void parallel_vector<T>::change_mode_begin(int quantum_index_l, int quantum_index_r, mods mode, bool is_replica) {
+    memory_manager::change_mode_begin(key, quantum_index_l, quantum_index_r, mode, is_replica);
+}
+
+template <class T>
+void parallel_vector<T>::change_mode_end() {
+    memory_manager::change_mode_end();
 }
 
 template<class T>
@@ -7,14 +7,19 @@
 #include "common.h"
 #include "mpi.h"
 
+struct waiting_process {
+    int process;
+    int reply_tag;  // тег, с которым ожидающий поток процесса принимает разрешение на блокировку
+};
+
 class queue_quantums
 {
-    std::vector<std::queue<int>> v_queues;  // вектор очередей, хранящих номера процессов, которые ждут освобождения квантов
+    std::vector<std::queue<waiting_process>> v_queues;  // вектор очередей процессов, которые ждут освобождения квантов
     int rank;
 public:
     queue_quantums(int num_quantums = 0);
-    void push(int quantum_number, int process);
-    int  pop(int quantum_number);
+    void push(int quantum_number, int process, int reply_tag);
+    waiting_process pop(int quantum_number);
     bool is_contain(int quantum_number);
     void resize(int num_quantums);
 };
@@ -0,0 +1,82 @@
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <mpi.h>
+#include "parallel_vector.h"
+#include "memory_manager.h"
+
+// несколько потоков вычислений на каждом рабочем процессе: обращения к общему вектору, блокировки и parallel_for
+int main(int argc, char** argv) {
+    std::string error_helper_string = "mpiexec -n <numproc> " + std::string(argv[0]) + " <length> [threads]";
+    if (argc <= 1) {
+        std::cout << "Error: you need to pass length of vector!" << std::endl;
+        std::cout << "Usage:\n" << error_helper_string << std::endl;
+        return 1;
+    }
+    memory_manager::init(argc, argv, error_helper_string);
+    int n = atoi(argv[1]);
+    int num_threads = (argc > 2) ? atoi(argv[2]) : 4;
+    int rank = memory_manager::get_MPI_rank();
+    int size = memory_manager::get_MPI_size();
+    int worker_size = size - 1;
+    const int increments = 20;
+    parallel_vector<int> pv(n, 10), counter(1);
+    int errors = 0;
+    if (rank != 0) {
+        double t1 = MPI_Wtime();
+        // потоки всех процессов записывают элементы вперемешку, кванты переходят между процессами
+        std::vector<std::thread> threads;
+        for (int t = 0; t < num_threads; ++t) {
+            threads.emplace_back([&, t]() {
+                for (int i = (rank - 1) * num_threads + t; i < n; i += worker_size * num_threads) {
+                    pv.set_elem(i, i);
+                }
+                for (int k = 0; k < increments; ++k) {
+                    counter.set_lock(0);
+                    counter.set_elem(0, counter.get_elem(0) + 1);
+                    counter.unset_lock(0);
+                }
+            });
+        }
+        for (auto& thread: threads) {
+            thread.join();
+        }
+        memory_manager::wait_all_workers();
+
+        // удвоение элементов квантов, оказавшихся на данном процессе
+        pv.parallel_for(num_threads, [](long long /*index*/, int& value) {
+            value *= 2;
+        });
+        memory_manager::wait_all_workers();
+
+        std::vector<long long> sums(num_threads, 0);
+        threads.clear();
+        for (int t = 0; t < num_threads; ++t) {
+            threads.emplace_back([&, t]() {
+                for (int i = t; i < n; i += num_threads) {
+                    sums[t] += pv.get_elem(i);
+                }
+            });
+        }
+        for (auto& thread: threads) {
+            thread.join();
+        }
+        double t2 = MPI_Wtime();
+        long long sum = 0;
+        for (long long s: sums) {
+            sum += s;
+        }
+        memory_manager::wait_all_workers();
+        if (rank == 1) {
+            int count = counter.get_elem(0);
+            if (sum != (long long)n * (n - 1) || count != worker_size * num_threads * increments) {
+                ++errors;
+            }
+            std::cout << "sum " << sum << " (expected " << (long long)n * (n - 1) << "), counter " << count
+                      << " (expected " << worker_size * num_threads * increments << "), time " << t2 - t1 << std::endl;
+        }
+    }
+    memory_manager::finalize();
+    return (errors > 0) ? 1 : 0;
+}
@@ -0,0 +1,52 @@
+#include <iostream>
+#include <string>
+#include <mpi.h>
+#include "parallel_vector.h"
+#include "memory_manager.h"
+
+// время обращения к элементам квантов, уже находящихся на процессе (get_elem/set_elem без обращения к каталогу)
+int main(int argc, char** argv) {
+    std::string error_helper_string = "mpiexec -n <numproc> " + std::string(argv[0]) + " <length> [repeats]";
+    if (argc <= 1) {
+        std::cout << "Error: you need to pass length of vector!" << std::endl;
+        std::cout << "Usage:\n" << error_helper_string << std::endl;
+        return 1;
+    }
+    memory_manager::init(argc, argv, error_helper_string);
+    int n = atoi(argv[1]);
+    int repeats = (argc > 2) ? atoi(argv[2]) : 100;
+    int rank = memory_manager::get_MPI_rank();
+    parallel_vector<int> pv(n, DEFAULT_QUANTUM_SIZE, DEFAULT_CACHE_SIZE, distribution(BLOCK));
+    if (rank != 0) {
+        // части вектора размещены на рабочих при создании, все обращения попадают в локальные кванты
+        long long l, r;
+        pv.local_range(l, r);
+        for (long long i = l; i < r; ++i) {
+            pv.set_elem(i, i);
+        }
+        memory_manager::wait_all_workers();
+
+        long long sum = 0;
+        double t1 = MPI_Wtime();
+        for (int k = 0; k < repeats; ++k) {
+            for (long long i = l; i < r; ++i) {
+                sum += pv.get_elem(i);
+            }
+        }
+        double t2 = MPI_Wtime();
+        for (int k = 0; k < repeats; ++k) {
+            for (long long i = l; i < r; ++i) {
+                pv.set_elem(i, i + k);
+            }
+        }
+        double t3 = MPI_Wtime();
+        long long accesses = (long long)repeats * (r - l);
+        if (accesses > 0) {
+            std::cout << "rank " << rank << ": get_elem " << (t2 - t1) * 1e9 / accesses << " ns, set_elem "
+                      << (t3 - t2) * 1e9 / accesses << " ns (" << accesses << " accesses, sum " << sum << ")" << std::endl;
+        }
+        memory_manager::wait_all_workers();
+    }
+    memory_manager::finalize();
+    return 0;
+}
@@ -1,5 +1,6 @@
 #include <iostream>
 #include <cmath>
+#include <algorithm>
 #include "memory_manager.h"
 #include "parallel_vector.h"
 
@@ -14,14 +15,32 @@ void matrix_mult(parallel_vector<T>& pv1, parallel_vector<T>& pv2, parallel_vect
             int i3_teq = i3 + i;
             int j3_teq = j3 + j;
             int temp = pv3.get_elem(i3_teq * n + j3_teq);
-            for (int k = 0; k < num_in_block; ++k) {
-                temp += pv1.get_elem((i1 + i) * n + j1 + k) * pv2.get_elem((i2 + j) * n + j2 + k);
+            // строки блоков перебираются частями, лежащими в одном кванте каждого вектора
+            int a = (i1 + i) * n + j1, b = (i2 + j) * n + j2, len = num_in_block;
+            while (len > 0) {
+                quantum_view<T> va = pv1.acquire_view(pv1.get_quantum(a), READ_ONLY);
+                quantum_view<T> vb = pv2.acquire_view(pv2.get_quantum(b), READ_ONLY);
+                const T* pa = va.data() + a % pv1.get_quantum_size();
+                const T* pb = vb.data() + b % pv2.get_quantum_size();
+                int cnt = std::min(len, static_cast<int>(std::min(va.end() - pa, vb.end() - pb)));
+                for (int k = 0; k < cnt; ++k) {
+                    temp += pa[k] * pb[k];
+                }
+                a += cnt, b += cnt, len -= cnt;
             }
             pv3.set_elem(i3_teq * n + j3_teq, temp);
         }
     }
 }
 
+// асинхронный запрос квантов блока, чтобы они пересылались во время вычислений над текущим блоком
+template<class T>
+void prefetch_block(const parallel_vector<T>& pv, int i_begin, int j_begin, int n, int num_in_block) {
+    for (int i = i_begin; i < i_begin + num_in_block; ++i) {
+        pv.prefetch(i * n + j_begin, i * n + j_begin + num_in_block);
+    }
+}
+
 template<class T>
 void print(parallel_vector<T>& pv1, parallel_vector<T>& pv2, parallel_vector<T>& pv3, int n) {
     for (int i = 0; i < n * n; ++i) {
@@ -45,8 +64,8 @@ void print(parallel_vector<T>& pv1, parallel_vector<T>& pv2, parallel_vector<T>&
     std::cout << std::endl;
 }
 
-int get_args(int argc, char** argv, int& n, int& cache_size, int q, int size_workers) {
-    n = -1, cache_size = DEFAULT_CACHE_SIZE;
+int get_args(int argc, char** argv, int& n, int& cache_size, int& cache_policy, long long& cache_budget, int q, int size_workers) {
+    n = -1, cache_size = DEFAULT_CACHE_SIZE, cache_policy = DEFAULT_CACHE_POLICY, cache_budget = DEFAULT_CACHE_BUDGET;
     for (int i = 1; i < argc; ++i) {
         if (std::string(argv[i]) == "-size") {
             if (i + 1 < argc) {
@@ -63,6 +82,29 @@ int get_args(int argc, char** argv, int& n, int& cache_size, int q, int size_wor
                 return -1;
             }
         }
+
+        // алгоритмы вытеснения сравниваются по числу кеш-промахов в cache_miss_cnt.txt
+        if (std::string(argv[i]) == "-cache_policy" || std::string(argv[i]) == "-cp") {
+            if (i + 1 < argc) {
+                cache_policy = -1;
+                std::string name = argv[++i];
+                for (int policy = CACHE_LRU; policy <= CACHE_LFU; ++policy) {
+                    if (name == get_cache_policy_name(policy))
+                        cache_policy = policy;
+                }
+            } else {
+                return -1;
+            }
+        }
+
+        // общий кеш всех матриц в байтах вместо cache_size квантов у каждой
+        if (std::string(argv[i]) == "-cache_budget" || std::string(argv[i]) == "-cb") {
+            if (i + 1 < argc) {
+                cache_budget = atoll(argv[++i]);
+            } else {
+                return -1;
+            }
+        }
     }
 
     if (n == -1) {
@@ -83,6 +125,18 @@ int get_args(int argc, char** argv, int& n, int& cache_size, int q, int size_wor
         return -1;
     }
 
+    if (cache_budget < 0) {
+        if (memory_manager::get_MPI_rank() == 1)
+            std::cerr << "cache_budget must be non-negative number!" << std::endl;
+        return -1;
+    }
+
+    if (cache_policy == -1) {
+        if (memory_manager::get_MPI_rank() == 1)
+            std::cerr << "cache_policy must be one of LRU, CLOCK, 2Q, ARC, LFU!" << std::endl;
+        return -1;
+    }
+
     if (q*q != size_workers) {
         if (memory_manager::get_MPI_rank() == 1)
             std::cerr << "count of processes must be n = q * q + 1, q - integer!" << std::endl;
@@ -100,7 +154,7 @@ int get_args(int argc, char** argv, int& n, int& cache_size, int q, int size_wor
 
 static void show_usage() {
     if (memory_manager::get_MPI_rank() == 1)
-        std::cerr << "Usage: mpiexec <-n number of processes> matrixmult <-size size_of_matrix> [-cache_size|-cs cache_size]"<<std::endl;
+        std::cerr << "Usage: mpiexec <-n number of processes> matrixmult <-size size_of_matrix> [-cache_size|-cs cache_size] [-cache_policy|-cp LRU|CLOCK|2Q|ARC|LFU] [-cache_budget|-cb bytes]"<<std::endl;
 }
 
 int main(int argc, char** argv) {
@@ -109,9 +163,10 @@ int main(int argc, char** argv) {
     int size_workers = memory_manager::get_MPI_size()-1;
     int q = static_cast<int>(sqrt(static_cast<double>(size_workers)));
 
-    int n = 0, cache_size = DEFAULT_CACHE_SIZE;
+    int n = 0, cache_size = DEFAULT_CACHE_SIZE, cache_policy = DEFAULT_CACHE_POLICY;
+    long long cache_budget = DEFAULT_CACHE_BUDGET;
 
-    int res = get_args(argc, argv, n, cache_size, q, size_workers);
+    int res = get_args(argc, argv, n, cache_size, cache_policy, cache_budget, q, size_workers);
     if (res == -1) {
         show_usage();
         memory_manager::finalize();
@@ -119,8 +174,11 @@ int main(int argc, char** argv) {
     }
 
     int num_in_block = n / q;
+    memory_manager::set_cache_budget(cache_budget);
 
-    parallel_vector<int> pv1(n * n, DEFAULT_QUANTUM_SIZE, cache_size), pv2(n * n, DEFAULT_QUANTUM_SIZE, cache_size), pv3(n * n, DEFAULT_QUANTUM_SIZE, cache_size);
+    parallel_vector<int> pv1(n * n, DEFAULT_QUANTUM_SIZE, cache_size, distribution(), cache_policy),
+                         pv2(n * n, DEFAULT_QUANTUM_SIZE, cache_size, distribution(), cache_policy),
+                         pv3(n * n, DEFAULT_QUANTUM_SIZE, cache_size, distribution(), cache_policy);
     std::pair<int, int> grid_ind = get_grid_rank(rank, q);
     MPI_Barrier(MPI_COMM_WORLD);
     double t1 = MPI_Wtime();
@@ -151,6 +209,11 @@ int main(int argc, char** argv) {
             int j2_begin = ((grid_ind.first + iter) % q) * num_in_block;
             int i3_begin = grid_ind.first * num_in_block;
             int j3_begin = grid_ind.second * num_in_block;
+            if (iter + 1 < q) {
+                int j_next = ((grid_ind.first + iter + 1) % q) * num_in_block;
+                prefetch_block(pv1, i_begin, j_next, n, num_in_block);
+                prefetch_block(pv2, i2_begin, j_next, n, num_in_block);
+            }
             matrix_mult(pv1, pv2, pv3, i_begin, j_begin, i2_begin, j2_begin, i3_begin, j3_begin, n, num_in_block);
         }
     }
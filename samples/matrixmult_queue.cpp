@@ -136,13 +136,19 @@ void matrix_mult(parallel_vector<T>& pv1, parallel_vector<T>& pv2, parallel_vect
             for (int k = 0; k < num_in_block; ++k) {
                 temp += pv1.get_elem((i1 + i) * n + j1 + k) * pv2.get_elem((i2 + j) * n + j2 + k);
             }
-            pv3.set_lock(pv3.get_quantum(i3_teq * n + j3_teq));
-            pv3.set_elem(i3_teq * n + j3_teq, pv3.get_elem(i3_teq * n + j3_teq) + temp);
-            pv3.unset_lock(pv3.get_quantum(i3_teq * n + j3_teq));
+            pv3.accumulate(i3_teq * n + j3_teq, temp, OP_SUM);  // сложение выполняется владельцем кванта, квант не перемещается
         }
     }
 }
 
+// асинхронный запрос квантов блока, чтобы они пересылались одновременно, а не по одному при первом обращении
+template<class T>
+void prefetch_block(const parallel_vector<T>& pv, int i_begin, int j_begin, int n, int num_in_block) {
+    for (int i = i_begin; i < i_begin + num_in_block; ++i) {
+        pv.prefetch(i * n + j_begin, i * n + j_begin + num_in_block);
+    }
+}
+
 struct task {
     int a_first, a_second, b_first, b_second;
 };
@@ -174,8 +180,9 @@ int main(int argc, char** argv) { // матрица b транспонирова
     }
     memory_manager::wait_all();
     if (rank != 0) {
-        pva.change_mode(0, pva.get_num_quantums(), READ_ONLY);
-        pvb.change_mode(0, pvb.get_num_quantums(), READ_ONLY);
+        // каждый процесс читает все блоки матриц, поэтому копии рассылаются заранее
+        pva.change_mode(0, pva.get_num_quantums(), READ_ONLY, true);
+        pvb.change_mode(0, pvb.get_num_quantums(), READ_ONLY, true);
     }
     // if (rank == 1)
     //     print_matrices(pva, pvb, pvc, n);
@@ -228,6 +235,8 @@ int main(int argc, char** argv) { // матрица b транспонирова
                     int a_second = t.a_second * part_size;
                     int b_first = t.b_first * part_size;
                     int b_second = t.b_second * part_size;
+                    prefetch_block(pva, a_first, a_second, n, part_size);
+                    prefetch_block(pvb, b_first, b_second, n, part_size);
                     matrix_mult(pva, pvb, pvc, a_first, a_second, b_first, b_second, a_first, b_first, n, part_size);
                 }
                 memory_manager::notify(1);
@@ -32,25 +32,28 @@ int main(int argc, char** argv) { // b * a
             index = (portion + 1) * (m % worker_size) * n + portion * (worker_rank - m % worker_size) * n;
         }
         // инициализация
-        for (int i = index; i < index + portion * n; ++i) {
-            pv.set_elem(i, i);
+        std::vector<int> init(portion * n);
+        for (int i = 0; i < portion * n; ++i) {
+            init[i] = index + i;
         }
-        for (int i = 0; i < n; ++i)
+        pv.set_range(index, index + portion * n, init.data());
+        pv.change_mode_begin(0, pv.get_num_quantums(), READ_ONLY);
+        for (int i = 0; i < n; ++i)  // заполнение локального вектора, пока другие процессы доходят до смены режима
             b[i] = i;
-        pv.change_mode(0, pv.get_num_quantums(), READ_ONLY);
+        pv.change_mode_end();
         std::vector<int>tmp_ans(portion);
+        std::vector<int> row(n);
         int t = 0;
         for (int i = index / m; i < index / m + portion; ++i) {
             tmp_ans[t] = 0;
+            pv.get_range(i * n, i * n + n, row.data());
             for (int j = 0; j < n; ++j) {
-                tmp_ans[t] += pv.get_elem(i * n + j) * b[j];
+                tmp_ans[t] += row[j] * b[j];
             }
             ++t;
         }
         // копирование элементов в вектор, с которого можно будет получить данные на любом процессе
-        for (int i = index / m; i < index / m + portion; ++i) {
-            ans.set_elem(i, tmp_ans[i - index / m]);
-        }
+        ans.set_range(index / m, index / m + portion, tmp_ans.data());
     }
     memory_manager::wait_all();
     double t3 = MPI_Wtime();
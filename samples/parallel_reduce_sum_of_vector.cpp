@@ -16,8 +16,10 @@ public:
     }
     T operator()(int l, int r, T identity) const {
         T ans = identity;
-        for (int i = l; i < r; ++i)
-            ans+=a->get_elem(i);
+        std::vector<T> buffer(r - l);
+        a->get_range(l, r, buffer.data());
+        for (int i = 0; i < r - l; ++i)
+            ans+=buffer[i];
         return ans;
     }
 };
@@ -54,9 +56,11 @@ int main(int argc, char ** argv) {
         } else {
             index = (portion + 1) * (n % worker_size) + portion * (worker_rank - n % worker_size);
         }
-        for (int i = index; i < index + portion; ++i) { // инициализация элементов вектора
-            pv.set_elem(i, i + 0.5);
+        std::vector<double> init(portion);
+        for (int i = 0; i < portion; ++i) { // инициализация элементов вектора
+            init[i] = index + i + 0.5;
         }
+        pv.set_range(index, index + portion, init.data());
         pv.change_mode(0, pv.get_num_quantums(), READ_ONLY);// так как далее вектор изменяться не будет, режим изменяется на READ_ONLY
         double ans = parallel_reduce(index, index + portion, pv, 0., 1, size-1, Func<double>(pv), reduction<double>, 1);
         // double ans2 = parallel_reduce_all(index, index + portion, pv, 0., 1, size-1, Func<double>(pv), reduction<double>);
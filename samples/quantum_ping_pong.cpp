@@ -0,0 +1,41 @@
+#include <iostream>
+#include <string>
+#include <mpi.h>
+#include "parallel_vector.h"
+#include "memory_manager.h"
+
+// рабочие увеличивают каждый свой элемент одного кванта: без аренды (LEASE_TIME_US) квант передаётся почти при каждом обращении,
+// число передач кванта записывается в quantums_migrations_<rank>.txt
+int main(int argc, char** argv) {
+    std::string error_helper_string = "mpiexec -n <numproc> " + std::string(argv[0]) + " <iterations>";
+    if (argc <= 1) {
+        std::cout << "Error: you need to pass number of iterations!" << std::endl;
+        std::cout << "Usage:\n" << error_helper_string << std::endl;
+        return 1;
+    }
+    memory_manager::init(argc, argv, error_helper_string);
+    int iterations = atoi(argv[1]);
+    int rank = memory_manager::get_MPI_rank();
+    int size = memory_manager::get_MPI_size();
+    parallel_vector<int> pv(size - 1);
+    int errors = 0;
+    if (rank != 0) {
+        pv.set_elem(rank - 1, 0);
+        memory_manager::wait_all_workers();
+        double t1 = MPI_Wtime();
+        for (int k = 0; k < iterations; ++k) {
+            pv.set_elem(rank - 1, pv.get_elem(rank - 1) + 1);
+        }
+        memory_manager::wait_all_workers();
+        double t2 = MPI_Wtime();
+        if (rank == 1) {
+            for (int i = 0; i < size - 1; ++i) {
+                if (pv.get_elem(i) != iterations)
+                    ++errors;
+            }
+            std::cout << "errors " << errors << ", time " << t2 - t1 << std::endl;
+        }
+    }
+    memory_manager::finalize();
+    return (errors > 0) ? 1 : 0;
+}
@@ -0,0 +1,51 @@
+#include <iostream>
+#include <string>
+#include <mpi.h>
+#include "parallel_vector.h"
+#include "memory_manager.h"
+
+// все процессы записывают элементы вектора вперемешку: в WRITE_SHARED режиме каждый процесс пишет в свою копию кванта,
+// и изменения сливаются у владельца при смене режима; для сравнения то же в READ_WRITE режиме, где квант переходит между процессами
+int main(int argc, char** argv) {
+    std::string error_helper_string = "mpiexec -n <numproc> " + std::string(argv[0]) + " <length> [quantum_size]";
+    if (argc <= 1) {
+        std::cout << "Error: you need to pass length of vector!" << std::endl;
+        std::cout << "Usage:\n" << error_helper_string << std::endl;
+        return 1;
+    }
+    memory_manager::init(argc, argv, error_helper_string);
+    int n = atoi(argv[1]);
+    int quantum_size = (argc > 2) ? atoi(argv[2]) : DEFAULT_QUANTUM_SIZE;
+    int rank = memory_manager::get_MPI_rank();
+    int worker_size = memory_manager::get_MPI_size() - 1;
+    parallel_vector<int> shared(n, quantum_size), exclusive(n, quantum_size);
+    int errors = 0;
+    if (rank != 0) {
+        auto fill = [&](parallel_vector<int>& pv) {
+            for (int i = rank - 1; i < n; i += worker_size) {
+                pv.set_elem(i, 2 * i + 1);
+            }
+        };
+        shared.change_mode(0, shared.get_num_quantums(), WRITE_SHARED);
+        double t1 = MPI_Wtime();
+        shared.prefetch(0, n);  // копии квантов запрашиваются асинхронно
+        fill(shared);
+        shared.change_mode(0, shared.get_num_quantums(), READ_ONLY);  // изменения всех процессов записываются в кванты владельцев
+        double t2 = MPI_Wtime();
+        fill(exclusive);
+        exclusive.change_mode(0, exclusive.get_num_quantums(), READ_ONLY);
+        double t3 = MPI_Wtime();
+
+        for (int i = 0; i < n; ++i) {
+            if (shared.get_elem(i) != 2 * i + 1 || exclusive.get_elem(i) != 2 * i + 1) {
+                ++errors;
+            }
+        }
+        memory_manager::wait_all_workers();
+        if (rank == 1 || errors > 0) {
+            std::cout << "rank " << rank << ": WRITE_SHARED " << t2 - t1 << " s, READ_WRITE " << t3 - t2 << " s, errors " << errors << std::endl;
+        }
+    }
+    memory_manager::finalize();
+    return (errors > 0) ? 1 : 0;
+}
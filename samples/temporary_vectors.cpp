@@ -0,0 +1,52 @@
+#include <iostream>
+#include <string>
+#include <mpi.h>
+#include "parallel_vector.h"
+#include "memory_manager.h"
+
+// на каждой итерации создаётся временный вектор, который уничтожается при выходе из области видимости:
+// память его квантов, кеш и части каталога освобождаются, и следующий вектор получает тот же идентификатор
+int main(int argc, char** argv) {
+    std::string error_helper_string = "mpiexec -n <numproc> " + std::string(argv[0]) + " <length> [iterations] [quantum_size] [cache_size]";
+    if (argc <= 1) {
+        std::cout << "Error: you need to pass length of vector!" << std::endl;
+        std::cout << "Usage:\n" << error_helper_string << std::endl;
+        return 1;
+    }
+    memory_manager::init(argc, argv, error_helper_string);
+    int n = atoi(argv[1]);
+    int iterations = (argc > 2) ? atoi(argv[2]) : 10;
+    int quantum_size = (argc > 3) ? atoi(argv[3]) : DEFAULT_QUANTUM_SIZE;
+    int cache_size = (argc > 4) ? atoi(argv[4]) : DEFAULT_CACHE_SIZE;
+    int rank = memory_manager::get_MPI_rank();
+    int worker_size = memory_manager::get_MPI_size() - 1;
+    int errors = 0, first_key = -1;
+    double t1 = MPI_Wtime();
+    for (int it = 0; it < iterations; ++it) {
+        parallel_vector<int> tmp(n, quantum_size, cache_size);  // создаётся и уничтожается всеми процессами
+        if (first_key == -1) {
+            first_key = tmp.get_key();
+        } else if (tmp.get_key() != first_key) {  // идентификатор уничтоженного вектора используется снова
+            ++errors;
+        }
+        if (rank != 0) {
+            for (int i = rank - 1; i < n; i += worker_size) {
+                tmp.set_elem(i, i + it);
+            }
+            tmp.change_mode(0, tmp.get_num_quantums(), READ_ONLY);
+            long long sum = 0;
+            for (int i = 0; i < n; ++i) {
+                sum += tmp.get_elem(i);
+            }
+            if (sum != (long long)n * (n - 1) / 2 + (long long)n * it) {
+                ++errors;
+            }
+        }
+    }
+    double t2 = MPI_Wtime();
+    if (rank == 1 || errors > 0) {
+        std::cout << "rank " << rank << ": " << iterations << " iterations " << t2 - t1 << " s, key " << first_key << ", errors " << errors << std::endl;
+    }
+    memory_manager::finalize();
+    return (errors > 0) ? 1 : 0;
+}
@@ -1,34 +1,253 @@
+#include <cstdlib>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
 #include "memory_allocator.h"
+#ifdef _WIN32
+    #include <malloc.h>
+#else
+    #include <unistd.h>
+    #include <sys/mman.h>
+#endif
 
 char* memory_allocator::alloc() {
-    const std::lock_guard<std::mutex> lockg(lock);
-    if (free_quantums.empty())  // если свободные кванты закончились, создаются новые
-        resize_internal();
-    char* quantum = free_quantums.front();
-    free_quantums.pop();
-    return quantum;
+    while (true) {
+        int slabs_cnt = number_of_slabs.load(std::memory_order_acquire);
+        for (int k = 0; k < slabs_cnt; ++k) {  // блок с наименьшим номером, в котором есть место
+            auto& info = slabs_info[k];
+            int allocated = info.allocated.load(std::memory_order_relaxed);
+            if (allocated < 0 || allocated >= (1 << k))  // блок заполнен или его страницы возвращаются системе
+                continue;
+            // квант резервируется до того, как взят из блока: пока счётчик не нулевой, страницы блока не возвращаются системе
+            if (info.allocated.fetch_add(1) < 0) {
+                info.allocated.fetch_sub(1);
+                continue;
+            }
+            char* quantum = nullptr;
+            if (pop(k, quantum) || bump(k, quantum))
+                return quantum;
+            info.allocated.fetch_sub(1);  // место в блоке заняли другие потоки
+        }
+        const std::lock_guard<std::mutex> lockg(lock);
+        if (number_of_slabs.load() == slabs_cnt)  // если свободные кванты закончились и другой поток не добавил блок, создаётся новый блок
+            resize_internal();
+    }
 }
 
 void memory_allocator::free(char** quantum) {
-    const std::lock_guard<std::mutex> lockg(lock);
-    free_quantums.push(*quantum);
+    int slab = find_slab(*quantum);
+    push(slab, *quantum);
     *quantum = nullptr;
+    // блок освободился, хотя ниже есть место: кванты выдаются из младших блоков, и число квантов процесса уменьшается
+    if (slabs_info[slab].allocated.fetch_sub(1) == 1 && slabs_info[slab].is_mapped && has_room_below(slab)) {
+        const std::lock_guard<std::mutex> lockg(lock);
+        release_free_slabs();
+    }
+}
+
+bool memory_allocator::pop(int slab, char*& quantum) {
+    auto& info = slabs_info[slab];
+    unsigned long long head = info.head.load(std::memory_order_acquire);
+    while ((head & 0xffffffffULL) != 0) {
+        char* top = memory[slab] + size_t((head & 0xffffffffULL) - 1) * stride;
+        // квант мог быть уже взят другим потоком и записан, тогда метка вершины изменилась и прочитанный номер не используется
+        int next;
+        std::memcpy(&next, top, sizeof(int));
+        unsigned long long new_head = ((head >> 32) + 1) << 32 | unsigned(next + 1);
+        if (info.head.compare_exchange_weak(head, new_head, std::memory_order_acquire, std::memory_order_acquire)) {
+            quantum = top;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool memory_allocator::bump(int slab, char*& quantum) {
+    auto& info = slabs_info[slab];
+    int used = info.used.load(std::memory_order_relaxed);
+    while (used < (1 << slab)) {
+        if (info.used.compare_exchange_weak(used, used + 1)) {
+            quantum = memory[slab] + size_t(used) * stride;
+            return true;
+        }
+    }
+    return false;
+}
+
+void memory_allocator::push(int slab, char* quantum) {
+    auto& info = slabs_info[slab];
+    unsigned index = unsigned((quantum - memory[slab]) / stride);
+    unsigned long long head = info.head.load(std::memory_order_relaxed), new_head;
+    do {
+        int next = int(head & 0xffffffffULL) - 1;
+        std::memcpy(quantum, &next, sizeof(int));
+        new_head = ((head >> 32) + 1) << 32 | (index + 1);
+    } while (!info.head.compare_exchange_weak(head, new_head, std::memory_order_release, std::memory_order_relaxed));
+}
+
+bool memory_allocator::has_room_below(int slab) {
+    for (int k = 0; k < slab; ++k) {
+        if (slabs_info[k].allocated.load(std::memory_order_relaxed) < (1 << k))
+            return true;
+    }
+    return false;
 }
 
 void memory_allocator::resize_internal() {
-    memory.emplace_back(new char[st * quantum_size]);
-    for (int i = 0; i < st; ++i) {
-        free_quantums.push(memory.back() + i * quantum_size);
+    int k = number_of_slabs.load();
+    CHECK(k < MAX_SLABS, STATUS_ERR_OUT_OF_BOUNDS);
+    memory[k] = map_slab(get_slab_bytes(k), slabs_info[k].is_mapped);
+#if (ENABLE_RMA_READ_ONLY)
+    if (win != MPI_WIN_NULL) {
+        MPI_Win_attach(win, memory[k], MPI_Aint(get_slab_bytes(k)));
+        MPI_Get_address(memory[k], &slabs[k]);
     }
-    st *= 2;
+#endif
+    number_of_slabs.store(k + 1, std::memory_order_release);  // блок виден другим потокам после заполнения его описания
 }
 
 void memory_allocator::set_quantum_size(int size_quantum, int size_of) {
     quantum_size = size_quantum * size_of;
+    stride = std::max(quantum_size, int(sizeof(int)));  // в освобождённом кванте хранится номер следующего кванта стека
+    if (quantum_size >= ALLOCATOR_ALIGNMENT) {  // небольшие кванты не выравниваются, чтобы не увеличивать память в разы
+        stride = (quantum_size + ALLOCATOR_ALIGNMENT - 1) / ALLOCATOR_ALIGNMENT * ALLOCATOR_ALIGNMENT;
+    }
+}
+
+int memory_allocator::find_slab(const char* quantum) {
+    int slabs_cnt = number_of_slabs.load(std::memory_order_acquire);
+    for (int k = 0; k < slabs_cnt; ++k) {
+        if (quantum >= memory[k] && quantum < memory[k] + get_slab_bytes(k)) {
+            return k;
+        }
+    }
+    ABORT(STATUS_ERR_OUT_OF_BOUNDS);
+    return -1;
+}
+
+size_t memory_allocator::get_slab_bytes(int slab) {
+    return (size_t(1) << slab) * stride;
+}
+
+void memory_allocator::release_free_slabs() {
+    bool has_room = false;  // в младших блоках есть место
+    for (int k = 0; k < number_of_slabs.load(); ++k) {
+        auto& info = slabs_info[k];
+        int expected = 0;
+        // блок без выданных и зарезервированных квантов закрывается для других потоков на время возврата страниц
+        if (has_room && info.is_mapped && info.used.load() > 0 && info.allocated.compare_exchange_strong(expected, SLAB_RELEASING)) {
+#ifndef _WIN32
+            static const size_t page_size = size_t(sysconf(_SC_PAGESIZE));
+            // адрес блока сохраняется, при следующем обращении страницы выделяются заново и заполняются нулями
+            madvise(memory[k], (get_slab_bytes(k) + page_size - 1) / page_size * page_size, MADV_DONTNEED);
+#endif
+            info.head.store(((info.head.load() >> 32) + 1) << 32);  // стек пуст, номера в освобождённых квантах больше не читаются
+            info.used.store(0);
+            info.allocated.fetch_sub(SLAB_RELEASING);
+        }
+        has_room = has_room || info.allocated.load() < (1 << k);
+    }
+}
+
+char* memory_allocator::map_slab(size_t bytes, bool& is_mapped) {
+    is_mapped = false;
+#ifdef _WIN32
+    char* slab = static_cast<char*>(_aligned_malloc(bytes, ALLOCATOR_ALIGNMENT));
+    CHECK(slab != nullptr, STATUS_ERR_NULLPTR);
+    return slab;
+#else
+    static const size_t page_size = size_t(sysconf(_SC_PAGESIZE));
+    if (bytes < page_size) {  // страницы небольших блоков не возвращаются системе
+        void* slab = nullptr;
+        CHECK(posix_memalign(&slab, ALLOCATOR_ALIGNMENT, bytes) == 0, STATUS_ERR_NULLPTR);
+        return static_cast<char*>(slab);
+    }
+    // блок от страницы отображается через mmap: он выровнен по странице, и его страницы можно вернуть системе
+    size_t length = (bytes + page_size - 1) / page_size * page_size;
+    size_t alignment = page_size;
+  #if (ENABLE_HUGE_PAGES)
+    if (length >= HUGE_PAGE_SIZE)
+        alignment = HUGE_PAGE_SIZE;
+  #endif
+    // для выравнивания больше страницы отображается с запасом, лишние страницы в начале и в конце освобождаются
+    size_t mapped = length + alignment - page_size;
+    void* region = mmap(nullptr, mapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    CHECK(region != MAP_FAILED, STATUS_ERR_NULLPTR);
+    char* begin = static_cast<char*>(region);
+    char* slab = begin + (alignment - reinterpret_cast<uintptr_t>(begin) % alignment) % alignment;
+    if (slab > begin)
+        munmap(begin, slab - begin);
+    if (slab + length < begin + mapped)
+        munmap(slab + length, begin + mapped - (slab + length));
+  #if (ENABLE_HUGE_PAGES) && defined(MADV_HUGEPAGE)
+    if (length >= HUGE_PAGE_SIZE)
+        madvise(slab, length, MADV_HUGEPAGE);
+  #endif
+    is_mapped = true;
+    return slab;
+#endif
+}
+
+void memory_allocator::unmap_slab(char* slab, size_t bytes, bool is_mapped) {
+#ifdef _WIN32
+    _aligned_free(slab);
+#else
+    if (is_mapped) {
+        static const size_t page_size = size_t(sysconf(_SC_PAGESIZE));
+        munmap(slab, (bytes + page_size - 1) / page_size * page_size);
+    } else {
+        std::free(slab);
+    }
+#endif
+}
+
+#if (ENABLE_RMA_READ_ONLY)
+void memory_allocator::attach(MPI_Win window) {
+    const std::lock_guard<std::mutex> lockg(lock);
+    win = window;
+    MPI_Win_attach(win, slabs, sizeof(slabs));
+    for (int k = 0; k < number_of_slabs.load(); ++k) {
+        MPI_Win_attach(win, memory[k], MPI_Aint(get_slab_bytes(k)));
+        MPI_Get_address(memory[k], &slabs[k]);
+    }
+}
+
+void memory_allocator::detach() {
+    const std::lock_guard<std::mutex> lockg(lock);
+    if (win == MPI_WIN_NULL)
+        return;
+    for (int k = 0; k < number_of_slabs.load(); ++k) {
+        MPI_Win_detach(win, memory[k]);
+    }
+    MPI_Win_detach(win, slabs);
+    win = MPI_WIN_NULL;
+}
+
+MPI_Aint memory_allocator::get_slabs_address() {
+    MPI_Aint address;
+    MPI_Get_address(slabs, &address);
+    return address;
+}
+
+int memory_allocator::get_slot(const char* quantum) {
+    int k = find_slab(quantum);
+    return (1 << k) - 1 + int((quantum - memory[k]) / stride);
+}
+
+int memory_allocator::get_slab(int slot) {
+    int k = 0;
+    while ((2LL << k) - 1 <= slot)
+        ++k;
+    return k;
+}
+
+MPI_Aint memory_allocator::get_offset(int slot) {
+    return MPI_Aint(slot - ((1 << get_slab(slot)) - 1)) * stride;
 }
+#endif
 
 memory_allocator::~memory_allocator() {
-    for(auto* i: memory) {
-        delete[] i;
+    for (int k = 0; k < number_of_slabs.load(); ++k) {
+        unmap_slab(memory[k], get_slab_bytes(k), slabs_info[k].is_mapped);
     }
 }
@@ -1,3 +1,4 @@
+#include <algorithm>
 #include "memory_cache.h"
 #include "common.h"
 
@@ -43,8 +44,8 @@ cache_node* cache_list::pop_back() {
     if (begin == end) {
         begin = end = nullptr;
     } else if (begin->next == end) {
-        begin = end;
-        begin->prev = begin->next = end->next = end->prev = nullptr;
+        end = begin;
+        begin->prev = begin->next = nullptr;
     } else {
         CHECK(end->prev != nullptr, STATUS_ERR_NULLPTR);
         end = end->prev;
@@ -69,6 +70,7 @@ void cache_list::delete_node(cache_node* node) {
         if (node->next) {
             node->next->prev = node->prev;
         }
+        --size;
     }
 }
 
@@ -76,9 +78,19 @@ bool cache_list::empty() {
     return begin == end && begin == nullptr;
 }
 
+int cache_list::get_size() {
+    return size;
+}
+
+cache_node* cache_list::front() {
+    return begin;
+}
+
 
 
 
+long long memory_cache::ticks = 0;
+
 memory_cache::memory_cache() {
     MPI_Comm_rank(MPI_COMM_WORLD, &rank);
     MPI_Comm_size(MPI_COMM_WORLD, &size);
@@ -89,11 +101,15 @@ memory_cache::memory_cache() {
 #endif
 }
 
-memory_cache::memory_cache(int cache_size, int number_of_quantums, MPI_Comm comm):
-                                        cache_memory(cache_size, {-1, nullptr, nullptr}),
+memory_cache::memory_cache(int cache_size, int number_of_quantums, MPI_Comm comm, int policy):
+                                        policy(policy),
+                                        cache_memory(cache_size, {-1, nullptr, nullptr, 0, false, 0}),
                                         contain_flags(number_of_quantums, nullptr),
                                         excluded(number_of_quantums, false),
+                                        pinned(number_of_quantums, false),
+                                        hits(new std::atomic<bool>[number_of_quantums]()),
                                         workers_comm(comm) {
+    CHECK(policy >= CACHE_LRU && policy <= CACHE_LFU, STATUS_ERR_OUT_OF_BOUNDS);
     MPI_Comm_rank(MPI_COMM_WORLD, &rank);
     MPI_Comm_size(MPI_COMM_WORLD, &size);
 #if (ENABLE_STATISTICS_COLLECTION)
@@ -104,6 +120,27 @@ memory_cache::memory_cache(int cache_size, int number_of_quantums, MPI_Comm comm
     for (int i = 0; i < cache_size; ++i) {
         free_cache_nodes.push_back(&cache_memory[i]);
     }
+    switch (policy) {
+    case CACHE_2Q:  // призраки помнят кванты, вытесненные из A1_IN, в размере половины кеша
+        queues.resize(3);
+        ghost_memory.resize(std::max(1, cache_size / 2), {-1, nullptr, nullptr, 0, false, 0});
+        break;
+    case CACHE_ARC:  // в ARC общее число призраков не больше размера кеша
+        queues.resize(4);
+        ghost_memory.resize(std::max(1, cache_size), {-1, nullptr, nullptr, 0, false, 0});
+        break;
+    case CACHE_LFU:  // очередь f содержит кванты с f + 1 обращениями в порядке LRU
+        queues.resize(LFU_MAX_FREQUENCY);
+        break;
+    default:
+        queues.resize(1);
+    }
+    if (!ghost_memory.empty()) {
+        ghost_flags.assign(number_of_quantums, nullptr);
+        for (auto& node: ghost_memory) {
+            free_ghost_nodes.push_back(&node);
+        }
+    }
 }
 
 memory_cache& memory_cache::operator=(const memory_cache& cache) {
@@ -120,8 +157,18 @@ memory_cache& memory_cache::operator=(const memory_cache& cache) {
         for (int i = 0; i < static_cast<int>(contain_flags.size()); ++i) {
             excluded[i] = cache.excluded[i];
         }
+        pinned = cache.pinned;
+        hits.reset(new std::atomic<bool>[pinned.size()]());
+        for (int i = 0; i < static_cast<int>(pinned.size()); ++i) {
+            hits[i].store(cache.hits[i].load(std::memory_order_relaxed), std::memory_order_relaxed);
+        }
         free_cache_nodes = cache.free_cache_nodes;
-        cache_indexes = cache.cache_indexes;
+        policy = cache.policy;
+        arc_target = cache.arc_target;
+        queues = cache.queues;
+        ghost_flags = cache.ghost_flags;
+        ghost_memory = cache.ghost_memory;
+        free_ghost_nodes = cache.free_ghost_nodes;
         workers_comm = cache.workers_comm;
 #if (ENABLE_STATISTICS_COLLECTION)
     #if (ENABLE_STATISTICS_CACHE_MISSES_CNT)
@@ -138,8 +185,16 @@ memory_cache& memory_cache::operator=(memory_cache&& cache) {
         cache_memory = std::move(cache.cache_memory);
         contain_flags = std::move(cache.contain_flags);
         excluded = std::move(cache.excluded);
+        pinned = std::move(cache.pinned);
+        hits = std::move(cache.hits);
         free_cache_nodes = cache.free_cache_nodes;
-        cache_indexes = cache.cache_indexes;
+        // узлы остаются в перемещённых векторах, поэтому очереди сохраняют указатели на них
+        policy = cache.policy;
+        arc_target = cache.arc_target;
+        queues = std::move(cache.queues);
+        ghost_flags = std::move(cache.ghost_flags);
+        ghost_memory = std::move(cache.ghost_memory);
+        free_ghost_nodes = cache.free_ghost_nodes;
         workers_comm = cache.workers_comm;
         #if (ENABLE_STATISTICS_COLLECTION)
             #if (ENABLE_STATISTICS_CACHE_MISSES_CNT)
@@ -153,13 +208,13 @@ memory_cache& memory_cache::operator=(memory_cache&& cache) {
     return *this;
 }
 
-int memory_cache::add(int quantum_index) {
+int memory_cache::add(int quantum_index, bool can_fold_hits) {
     CHECK(quantum_index >= 0 && quantum_index < (int)contain_flags.size(), STATUS_ERR_OUT_OF_BOUNDS);
     // элемент уже находится в кеше?
     if (is_contain(quantum_index)) {
-        // Least recently used (LRU) cache logic
-        cache_indexes.delete_node(contain_flags[quantum_index]);
-        cache_indexes.push_back(contain_flags[quantum_index]);
+        if (!pinned[quantum_index]) {
+            touch(contain_flags[quantum_index]);
+        }
         return -1;
     }
     // элемент находится в списке исключённых элементов?
@@ -178,34 +233,184 @@ int memory_cache::add(int quantum_index) {
   #endif
 #endif
 
+    // квант недавно вытеснялся?
+    int ghost_queue = -1;
+    if (!ghost_flags.empty() && ghost_flags[quantum_index] != nullptr) {
+        ghost_queue = ghost_flags[quantum_index]->queue;
+        if (policy == CACHE_ARC) {  // промах по призраку B1 означает, что T1 мала, по призраку B2 - что мала T2
+            int b1 = queues[B1].get_size(), b2 = queues[B2].get_size();
+            if (ghost_queue == B1) {
+                arc_target = std::min(get_cache_size(), arc_target + std::max(1, b2 / b1));
+            } else {
+                arc_target = std::max(0, arc_target - std::max(1, b1 / b2));
+            }
+        }
+        forget(quantum_index);
+    }
+
+    int return_value = -1;
+    cache_node* node;
     // список свободных элементов не пуст?
     if (!free_cache_nodes.empty()) {
         // взять элемент из списка свободных элементов
-        cache_node* node = free_cache_nodes.pop_front();
-        node->value = quantum_index;
-        cache_indexes.push_back(node);
-        contain_flags[quantum_index] = node;
-        return -1;
-    }
-
+        node = free_cache_nodes.pop_front();
+    } else {
 #if (ENABLE_STATISTICS_COLLECTION)
   #if (ENABLE_STATISTICS_CACHE_MISSES_CNT)
-    ++cache_miss_cnt_no_free;
+        ++cache_miss_cnt_no_free;
   #endif
 #endif
+        // вытеснение кванта из кеша текущим квантом
+        if (can_fold_hits)
+            fold_hits();
+        node = evict(ghost_queue);
+        return_value = node->value;
+        contain_flags[return_value] = nullptr;
+    }
+    node->value = quantum_index;
+    contain_flags[quantum_index] = node;
+    insert(node, ghost_queue);
+    return return_value;
+}
 
-    // вытеснение кванта из кеша текущим квантом
-    cache_node* node = cache_indexes.pop_front();
-    contain_flags[node->value] = nullptr;
+void memory_cache::touch(cache_node* node) {
+    node->tick = ++ticks;
+    hits[node->value].store(false, std::memory_order_relaxed);
+    int queue = node->queue;
+    switch (policy) {
+    case CACHE_CLOCK:  // очередь не меняется, поэтому обращение дешевле, чем в LRU
+        node->referenced = true;
+        return;
+    case CACHE_2Q:  // повторные обращения к кванту в A1_IN не учитываются: они обычно следуют сразу за первым
+        if (queue == A1_IN)
+            return;
+        break;
+    case CACHE_ARC:
+        queue = T2;
+        break;
+    case CACHE_LFU:
+        queue = std::min(queue + 1, LFU_MAX_FREQUENCY - 1);
+        break;
+    }
+    queues[node->queue].delete_node(node);
+    node->queue = queue;
+    queues[queue].push_back(node);
+}
 
-    int return_value = node->value;
+void memory_cache::insert(cache_node* node, int ghost_queue) {
+    int queue = 0;  // LRU, CLOCK и LFU
+    if (policy == CACHE_2Q) {
+        queue = (ghost_queue == A1_OUT) ? AM : A1_IN;
+    } else if (policy == CACHE_ARC) {
+        queue = (ghost_queue != -1) ? T2 : T1;
+    }
+    node->queue = queue;
+    node->referenced = false;
+    node->tick = ++ticks;
+    hits[node->value].store(false, std::memory_order_relaxed);  // обращения до промаха относятся к прошлой копии кванта
+    queues[queue].push_back(node);
+}
+
+cache_node* memory_cache::evict(int ghost_queue) {
+    CHECK(has_unpinned(), STATUS_ERR_OUT_OF_BOUNDS);  // все кванты в кеше закреплены
+    int queue = get_victim_queue(ghost_queue);
+    cache_node* node = queues[queue].pop_front();
+    switch (policy) {
+    case CACHE_CLOCK:  // начало очереди - стрелка; квант с битом обращения получает второй шанс и переносится в конец
+        // обращения без мьютекса могут продолжаться во время вытеснения, поэтому стрелка делает не больше двух оборотов
+        for (int steps = 2 * queues[0].get_size() + 1; steps > 0 && (node->referenced || hits[node->value].load(std::memory_order_relaxed)); --steps) {
+            if (hits[node->value].load(std::memory_order_relaxed))
+                touch(node);  // обращение без мьютекса учитывается, когда стрелка доходит до кванта
+            node->referenced = false;
+            queues[0].push_back(node);
+            node = queues[0].pop_front();
+        }
+        break;
+    case CACHE_2Q:
+        if (queue == A1_IN)
+            remember(A1_OUT, node->value);
+        break;
+    case CACHE_ARC:
+        remember(queue == T1 ? B1 : B2, node->value);
+        break;
+    }
+    return node;
+}
 
+int memory_cache::get_victim_queue(int ghost_queue) {
+    switch (policy) {
+    case CACHE_2Q:
+        return (queues[A1_IN].get_size() > std::max(1, get_cache_size() / 4) || queues[AM].empty()) ? A1_IN : AM;
+    case CACHE_ARC: {
+        int t1 = queues[T1].get_size();
+        return (t1 > 0 && (t1 > arc_target || (ghost_queue == B2 && t1 == arc_target) || queues[T2].empty())) ? T1 : T2;
+    }
+    case CACHE_LFU: {  // вытесняется квант с наименьшим числом обращений
+        int f = 0;
+        while (queues[f].empty())
+            ++f;
+        return f;
+    }
+    default:
+        return 0;
+    }
+}
+
+bool memory_cache::has_unpinned() {
+    for (int i = 0; i < get_num_resident_queues(); ++i) {
+        if (!queues[i].empty())
+            return true;
+    }
+    return false;
+}
+
+void memory_cache::fold_hits() {
+    // квант вытесняется из начала очереди, поэтому достаточно учесть обращения к первым квантам; touch переносит квант
+    // в конец очереди или в очередь с большим номером, а 2Q и CLOCK оставляют его на месте со снятым флагом
+    for (int i = 0; i < get_num_resident_queues(); ++i) {
+        cache_node* node = queues[i].front();
+        for (int n = queues[i].get_size(); n > 0 && node != nullptr && hits[node->value].load(std::memory_order_relaxed); --n) {
+            touch(node);
+            node = queues[i].front();
+        }
+    }
+}
+
+void memory_cache::remember(int queue, int quantum_index) {
+    cache_list& ghosts = queues[queue];
+    // ARC: кванты T1 и призраки B1 вместе занимают не больше размера кеша
+    if (policy == CACHE_ARC && queue == B1 && !ghosts.empty() && queues[T1].get_size() + ghosts.get_size() >= get_cache_size()) {
+        release_ghost(ghosts.pop_front());
+    }
+    if (free_ghost_nodes.empty()) {  // забывается самый старый призрак большей очереди призраков
+        int oldest = queue;
+        for (int i = get_num_resident_queues(); i < (int)queues.size(); ++i) {
+            if (queues[i].get_size() > queues[oldest].get_size())
+                oldest = i;
+        }
+        CHECK(!queues[oldest].empty(), STATUS_ERR_OUT_OF_BOUNDS);
+        release_ghost(queues[oldest].pop_front());
+    }
+    cache_node* node = free_ghost_nodes.pop_front();
     node->value = quantum_index;
-    contain_flags[quantum_index] = node;
+    node->queue = queue;
+    ghosts.push_back(node);
+    ghost_flags[quantum_index] = node;
+}
 
-    cache_indexes.push_back(node);
+void memory_cache::forget(int quantum_index) {
+    cache_node* node = ghost_flags[quantum_index];
+    queues[node->queue].delete_node(node);
+    release_ghost(node);
+}
 
-    return return_value;
+void memory_cache::release_ghost(cache_node* node) {
+    ghost_flags[node->value] = nullptr;
+    free_ghost_nodes.push_back(node);
+}
+
+int memory_cache::get_num_resident_queues() {
+    return (policy == CACHE_2Q || policy == CACHE_ARC) ? 2 : static_cast<int>(queues.size());
 }
 
 bool memory_cache::is_contain(int quantum_index) {
@@ -226,15 +431,95 @@ bool memory_cache::is_excluded(int quantum_index) {
 
 void memory_cache::delete_elem(int quantum_index) {
     CHECK(quantum_index >= 0 && quantum_index < (int)excluded.size(), STATUS_ERR_OUT_OF_BOUNDS);
+    CHECK(!pinned[quantum_index], STATUS_ERR_UNKNOWN);  // закреплённый квант нельзя удалить из кеша
     if (is_contain(quantum_index)) {
-        cache_indexes.delete_node(contain_flags[quantum_index]);
-        free_cache_nodes.push_back(contain_flags[quantum_index]);
+        cache_node* node = contain_flags[quantum_index];
+        queues[node->queue].delete_node(node);
+        free_cache_nodes.push_back(node);
         contain_flags[quantum_index] = nullptr;
     }
     excluded[quantum_index] = false;
 }
 
-void memory_cache::get_cache_miss_cnt_statistics(int key, int number_of_elements) {
+void memory_cache::pin(int quantum_index) {
+    CHECK(is_contain(quantum_index) && !pinned[quantum_index], STATUS_ERR_UNKNOWN);
+    cache_node* node = contain_flags[quantum_index];
+    queues[node->queue].delete_node(node);  // очередь узла сохраняется, при снятии закрепления квант возвращается в неё
+    pinned[quantum_index] = true;
+}
+
+void memory_cache::unpin(int quantum_index) {
+    CHECK(is_contain(quantum_index) && pinned[quantum_index], STATUS_ERR_UNKNOWN);
+    cache_node* node = contain_flags[quantum_index];
+    queues[node->queue].push_back(node);
+    pinned[quantum_index] = false;
+    touch(node);  // кванты закреплённого представления читались без обращений к кешу
+}
+
+void memory_cache::hit(int quantum_index) {
+    // флаг записывается только при изменении, чтобы частые обращения не делали строку кеша процессора изменённой
+    if (!hits[quantum_index].load(std::memory_order_relaxed)) {
+        hits[quantum_index].store(true, std::memory_order_relaxed);
+    }
+}
+
+bool memory_cache::is_pinned(int quantum_index) {
+    CHECK(quantum_index >= 0 && quantum_index < (int)pinned.size(), STATUS_ERR_OUT_OF_BOUNDS);
+    return pinned[quantum_index];
+}
+
+int memory_cache::get_num_pinned() {
+    return static_cast<int>(std::count(pinned.begin(), pinned.end(), true));
+}
+
+int memory_cache::get_cache_size() {
+    return static_cast<int>(cache_memory.size());
+}
+
+int memory_cache::get_num_cached() {
+    return get_cache_size() - free_cache_nodes.get_size();
+}
+
+int memory_cache::get_cache_policy() {
+    return policy;
+}
+
+int memory_cache::evict_one() {
+    fold_hits();
+    if (!has_unpinned())
+        return -1;
+#if (ENABLE_STATISTICS_COLLECTION)
+  #if (ENABLE_STATISTICS_CACHE_MISSES_CNT)
+    ++cache_miss_cnt_no_free;
+  #endif
+#endif
+    cache_node* node = evict(-1);
+    int quantum_index = node->value;
+    contain_flags[quantum_index] = nullptr;
+    free_cache_nodes.push_back(node);
+    return quantum_index;
+}
+
+long long memory_cache::get_coldest_tick() {
+    fold_hits();  // время узла - время последнего обращения, в том числе без мьютекса
+    if (!has_unpinned())
+        return -1;
+    cache_node* node = queues[get_victim_queue(-1)].front();
+    if (policy == CACHE_CLOCK) {  // стрелка пропускает кванты с битом обращения, если бит есть у всех, вытесняется первый
+        cache_node* unreferenced = node;
+        while (unreferenced != nullptr && (unreferenced->referenced || hits[unreferenced->value].load(std::memory_order_relaxed)))
+            unreferenced = unreferenced->next;
+        if (unreferenced != nullptr)
+            node = unreferenced;
+    }
+    return node->tick;
+}
+
+long long memory_cache::get_ticks() {
+    return ticks;
+}
+
+void memory_cache::get_cache_miss_cnt_statistics(int key, long long number_of_elements) {
 #if (ENABLE_STATISTICS_COLLECTION)
   #if (ENABLE_STATISTICS_EVERY_CACHE_MISSES)
     if (statistic_file_stream.is_open()) {
@@ -251,7 +536,7 @@ void memory_cache::get_cache_miss_cnt_statistics(int key, int number_of_elements
     if (rank == 1) {
         cache_miss_cnt_file_stream.open("cache_miss_cnt.txt", std::ios_base::app);
         cache_miss_cnt_file_stream << "------------------------------\n";
-        cache_miss_cnt_file_stream << "cache_size: " << cache_memory.size() << "; number_of_elements: " << number_of_elements << "; number_of_processes: " << size << "; key: " << key <<";\n";
+        cache_miss_cnt_file_stream << "cache_size: " << cache_memory.size() << "; cache_policy: " << get_cache_policy_name(policy) << "; number_of_elements: " << number_of_elements << "; number_of_processes: " << size << "; key: " << key <<";\n";
         int cnt = 0, cnt_evictions = 0;
         for (int i = 0; i < (int)cache_miss_cnts.size(); ++i) {
             cache_miss_cnt_file_stream << "rank " << i + 1 << ": "<< cache_miss_cnts[i] << "; ";
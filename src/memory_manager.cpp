@@ -1,20 +1,78 @@
 #include "memory_manager.h"
 
-// посылка мастеру: [операция; идентификатор структуры, откуда требуются данные; требуемый номер кванта]
-// посылка рабочему от мастера: [операция; идентификатор структуры, откуда требуются данные;
-//                               требуемый номер кванта; номер процесса, которому требуется передать квант]
-// если номер структуры = -1, то завершение функций worker_helper_thread и master_helper_thread
+// каталог квантов разделён между всеми процессами: квант quantum_index хранится в части каталога процесса get_home(key, quantum_index)
+// посылка каталогу: одна или несколько записей [операция; идентификатор структуры, откуда требуются данные;
+//                   требуемый номер кванта; аргумент операции (для GET_INFO - тег ответа); тег, с которым рабочий перешлёт квант (для SET_INFO - номер ячейки кванта)]
+// посылка рабочему от каталога: одна или несколько записей [операция; идентификатор структуры, откуда требуются данные;
+//                                                         требуемый номер кванта; номер процесса, которому требуется передать квант; тег пересылки]
+// записи накапливаются в посылке каждому получателю и отправляются перед блокирующим ожиданием или возвратом управления пользователю
+// ответ каталога на запрос кванта: [номер процесса, передающего квант; номер ячейки кванта в памяти этого процесса или -1];
+// номер ячейки передаётся только при ENABLE_RMA_READ_ONLY в READ_ONLY режиме, тогда квант читается через MPI_Get
+// в READ_WRITE режиме каталог передаёт право владения сразу: прежний владелец пересылает квант, как только сам его получит;
+// на синхронный запрос GET_GRANT каталог не отвечает, если квант пересылается, - квант приходит от владельца вместе с правом владения;
+// SET_INFO только учитывает завершённые пересылки и уходит при следующей отправке посылок
+// при LEASE_TIME_US > 0 полученный READ_WRITE квант арендуется: вспомогательный поток откладывает GET_DATA_RW до окончания аренды
+// (LEASE_TIME_US микросекунд или LEASE_ACCESSES обращений) и, пока есть отложенные запросы, проверяет посылки без блокировки
+// при ENABLE_OWNER_HINTS READ_ONLY квант сначала запрашивается GET_DATA_HINT напрямую у процесса, передавшего его в прошлый раз;
+// вспомогательный поток отвечает квантом или пустым сообщением, во втором случае квант запрашивается у каталога
+// каждая часть каталога обслуживается NUMBER_OF_MASTER_HELPERS потоками, поток t обслуживает структуры с key % NUMBER_OF_MASTER_HELPERS == t
+// и принимает посылки с тегом SEND_DATA_TO_MASTER_HELPER + t; записи разным потокам каталога отправляются разными посылками
+// ACCUMULATE и FETCH_AND_OP выполняются процессом-владельцем кванта: за записью [операция; идентификатор структуры; номер кванта;
+// номер элемента в кванте; операция accumulate] следуют get_payload_records записей данных [номер запросившего процесса; значение],
+// каталог пересылает их владельцу в том же порядке, что и запросы кванта, поэтому операция выполняется до передачи кванта дальше;
+// владелец, ещё не получивший квант, выполняет операцию по его приёме; о выполнении ACCUMULATE владелец сообщает одним сообщением
+// на посылку, ответ на FETCH_AND_OP - прежнее значение элемента; записи ACCUMULATE, как и SET_INFO, уходят при следующей отправке посылок
+// в WRITE_SHARED режиме каталог отвечает на запрос кванта владельцем, который пересылает копию; получатель сохраняет двойник копии,
+// при смене режима сравнивает с ним копию и для каждого отрезка изменённых элементов отправляет запись [DIFF; идентификатор структуры;
+// номер кванта; номер первого элемента; число элементов] с данными [номер процесса; значения], которую каталог пересылает владельцу, как ACCUMULATE;
+// в записи CHANGE_MODE аргумент - 2 * новый режим + 1, если процесс запросил копии квантов
+// посылки содержат только номера квантов и номера элементов в кванте, поэтому записи остаются из int и при 64-битных номерах элементов;
+// число квантов структуры не превышает INT_MAX
+// destroy_object: рабочий отправляет запись DESTROY каждой части каталога и больше не отправляет посылок по структуре; часть каталога,
+// получив DESTROY от всех рабочих, освобождает свои кванты и отправляет DESTROY каждому рабочему вслед за своими посылками по структуре;
+// рабочий освобождает память структуры, когда его вспомогательный поток получил DESTROY от всех частей каталога
+// запись из -1 в посылке каталогу означает, что процесс-рабочий завершил работу, такая запись отправляется каждому потоку каталога;
+// master_helper_thread завершается, когда такие записи пришли от всех рабочих
 
 
-std::vector<memory_line_common*> memory_manager::memory;  // структура-хранилище памяти и вспомогательной информации
+std::vector<memory_line_worker*> memory_manager::memory;  // структура-хранилище памяти и вспомогательной информации
+std::vector<memory_line_master*> memory_manager::directory;  // часть каталога квантов, обслуживаемая данным процессом
 std::thread memory_manager::helper_thr;  // вспомогательный поток
+std::vector<std::thread> memory_manager::master_helper_thrs;  // потоки, обслуживающие часть каталога квантов
 int memory_manager::rank;  // ранг процесса в MPI
 int memory_manager::size;  // число процессов в MPI
 int memory_manager::worker_rank;  // worker_rank = rank-1
 int memory_manager::worker_size;  // worker_size = size-1
-int memory_manager::proc_count_ready = 0;
+thread_local int memory_manager::proc_count_ready = 0;
 MPI_File memory_manager::fh;
 MPI_Comm memory_manager::workers_comm;
+std::vector<pending_request> memory_manager::pending(MAX_PENDING_REQUESTS);
+std::vector<MPI_Request> memory_manager::pending_info(2 * MAX_PENDING_REQUESTS, MPI_REQUEST_NULL);
+int memory_manager::next_pending = 0;
+mode_change memory_manager::current_mode_change;
+int memory_manager::pending_count = 0;
+std::vector<std::vector<int>> memory_manager::to_directory;
+std::recursive_mutex memory_manager::compute_mutex;
+std::vector<bool> memory_manager::lock_waiters(MAX_LOCK_WAITERS, false);
+std::atomic<unsigned long long> memory_manager::global_epoch(1);
+std::atomic<unsigned long long> memory_manager::thread_epochs[MAX_COMPUTE_THREADS];
+thread_local std::atomic<unsigned long long>* memory_manager::thread_epoch = nullptr;
+thread_local epoch_slot memory_manager::thread_epoch_slot;
+thread_local std::vector<std::vector<int>> memory_manager::to_helpers;
+std::function<void(char*, const char*)> memory_manager::user_ops[MAX_USER_OPS];
+int memory_manager::number_of_user_ops = 0;
+int memory_manager::accumulates_in_flight = 0;
+bool memory_manager::is_finalized = false;
+long long memory_manager::cache_budget = DEFAULT_CACHE_BUDGET;
+#if (ENABLE_STATISTICS_COLLECTION)
+  #if (ENABLE_STATISTICS_MESSAGES_CNT)
+std::vector<long long> memory_manager::records_cnt(NUMBER_OF_OPERATIONS + 1, 0);
+std::vector<long long> memory_manager::messages_cnt(NUMBER_OF_OPERATIONS + 1, 0);
+std::vector<long long> memory_manager::helper_records_cnt(NUMBER_OF_OPERATIONS + 1, 0);
+std::vector<long long> memory_manager::helper_messages_cnt(NUMBER_OF_OPERATIONS + 1, 0);
+std::mutex memory_manager::helper_statistics_mutex;
+  #endif
+#endif
 
 void memory_manager::init(int argc, char**argv, std::string error_helper_str) {
     int provided = 0;
@@ -34,9 +92,11 @@ void memory_manager::init(int argc, char**argv, std::string error_helper_str) {
     }
     worker_rank = rank - 1;
     worker_size = size - 1;
-    if (rank == 0) {
-        helper_thr = std::thread(master_helper_thread);
-    } else {
+    to_directory.resize(size * NUMBER_OF_MASTER_HELPERS);
+    for (int thread_index = 0; thread_index < NUMBER_OF_MASTER_HELPERS; ++thread_index) {
+        master_helper_thrs.emplace_back(master_helper_thread, thread_index);  // каждый процесс обслуживает свою часть каталога
+    }
+    if (rank != 0) {
         helper_thr = std::thread(worker_helper_thread);
     }
 
@@ -58,374 +118,557 @@ int memory_manager::get_MPI_size() {
     return size;
 }
 
-int memory_manager::get_quantum_index(int key, int index) {
-    return index/memory_manager::memory[key]->quantum_size;
+int memory_manager::get_quantum_index(int key, long long index) {
+    return int(index/memory_manager::memory[key]->quantum_size);
 }
 
 int memory_manager::get_quantum_size(int key) {
     return memory_manager::memory[key]->quantum_size;
 }
 
+int memory_manager::get_home(int key, int quantum_index) {
+    int num_of_quantums = int((memory[key]->logical_size + memory[key]->quantum_size - 1) / memory[key]->quantum_size);
+    return int((long long)quantum_index * size / num_of_quantums);
+}
+
+int memory_manager::get_first_quantum(int num_of_quantums, int process) {
+    return int(((long long)process * num_of_quantums + size - 1) / size);
+}
+
+int memory_manager::get_master_helper(int key) {
+    return key % NUMBER_OF_MASTER_HELPERS;
+}
+
+int distribution::get_owner(int quantum_index, int num_of_quantums, int worker_size) const {
+    switch (kind) {
+    case BLOCK:        return 1 + int((long long)quantum_index * worker_size / num_of_quantums);
+    case CYCLIC:       return 1 + quantum_index % worker_size;
+    case BLOCK_CYCLIC: return 1 + quantum_index / block_size % worker_size;
+    case CUSTOM:       return mapping(quantum_index);
+    default:           return -1;
+    }
+}
+
+int memory_manager::get_initial_owner(int key, int quantum_index) {
+    auto* memory = memory_manager::memory[key];
+    int num_of_quantums = int((memory->logical_size + memory->quantum_size - 1) / memory->quantum_size);
+    CHECK(quantum_index >= 0 && quantum_index < num_of_quantums, STATUS_ERR_OUT_OF_BOUNDS);
+    return memory->dist.get_owner(quantum_index, num_of_quantums, worker_size);
+}
+
+void memory_manager::get_local_range(int key, long long& l, long long& r) {
+    auto* memory = memory_manager::memory[key];
+    CHECK(memory->dist.kind == BLOCK, STATUS_ERR_UNKNOWN);  // при остальных распределениях кванты процесса не образуют диапазон
+    int num_of_quantums = int((memory->logical_size + memory->quantum_size - 1) / memory->quantum_size);
+    // первый квант рабочего w - наименьший q с q * worker_size / num_of_quantums >= w
+    auto first_quantum = [&](int w) { return int(((long long)w * num_of_quantums + worker_size - 1) / worker_size); };
+    if (rank == 0) {
+        l = r = 0;
+        return;
+    }
+    l = (long long)first_quantum(worker_rank) * memory->quantum_size;
+    r = std::min((long long)first_quantum(worker_rank + 1) * memory->quantum_size, memory->logical_size);
+}
+
+void memory_manager::destroy_object(int key) {
+    if (is_finalized)  // память всех структур освобождена в finalize
+        return;
+    CHECK(key >= 0 && key < (int)memory.size() && memory[key] != nullptr, STATUS_ERR_OUT_OF_BOUNDS);
+    if (rank != 0) {
+        std::lock_guard<std::recursive_mutex> lock(compute_mutex);
+        CHECK(current_mode_change.key != key, STATUS_ERR_UNKNOWN);  // смена режима структуры не завершена
+        wait_all_pending();
+        wait_accumulates();
+        for (int home = 0; home < size; ++home) {  // части каталога есть на всех процессах, в том числе пустые
+            post_request(home, {DESTROY, key, -1, -1, -1});
+        }
+        flush_requests();
+        // части каталога освобождены, и вспомогательный поток обработал все их посылки по структуре
+        for (int home = 0; home < size; ++home) {
+            int done;
+            MPI_Status status;
+            MPI_Recv(&done, 1, MPI_INT, rank, OBJECT_DESTROYED, MPI_COMM_WORLD, &status);
+        }
+        auto* memory = memory_manager::memory[key];
+#if (ENABLE_STATISTICS_COLLECTION)
+    #if (ENABLE_STATISTICS_CACHE_MISSES_CNT)
+        memory->cache.get_cache_miss_cnt_statistics(key, memory->quantums.size() * memory->quantum_size);
+    #endif
+#endif
+#if (ENABLE_RMA_READ_ONLY)
+        if (memory->win != MPI_WIN_NULL) {  // окно закрывается коллективно всеми рабочими, чтений через MPI_Get больше нет
+            MPI_Win_unlock_all(memory->win);
+            memory->allocator.detach();
+            MPI_Win_free(&memory->win);
+        }
+#endif
+    }
+    delete memory[key];  // блоки распределителя освобождаются вместе со структурой
+    memory[key] = nullptr;
+    MPI_Barrier(MPI_COMM_WORLD);  // после барьера идентификатор можно выдать новой структуре
+}
+
 void worker_helper_thread() {
-    int request[4] = {-2, -2, -2, -2};
+    std::vector<int> request(REQUEST_SIZE, -2);
     MPI_Status status;
     int rank, size;
     MPI_Comm_rank(MPI_COMM_WORLD, &rank);
     MPI_Comm_size(MPI_COMM_WORLD, &size);
-    while (true) {
-        MPI_Recv(request, 4, MPI_INT, MPI_ANY_SOURCE, SEND_DATA_TO_HELPER, MPI_COMM_WORLD, &status);
-        if (request[0] == -1 && request[1] == -1 && request[2] == -1 && request[3] == -1) {  // окончание работы вспомогательного потока
-            // освобождение памяти
+    std::vector<int> acks(size, 0);  // число выполненных по посылке ACCUMULATE каждого процесса
+    std::vector<std::pair<int, int>> leased;  // кванты с запросом GET_DATA_RW, отложенным до окончания аренды
+    bool is_finished = false;
+    while (!is_finished) {
+        // посылка состоит из одной или нескольких записей по REQUEST_SIZE int
+        int count = 0, has_message = 0;
+        while (!leased.empty() && !has_message) {  // пока есть арендованные кванты, посылки проверяются без блокировки
+            MPI_Iprobe(MPI_ANY_SOURCE, SEND_DATA_TO_HELPER, MPI_COMM_WORLD, &has_message, &status);
+            if (!has_message) {
+                memory_manager::serve_leases(leased);
+                std::this_thread::yield();
+            }
+        }
+        if (!has_message)
+            MPI_Probe(MPI_ANY_SOURCE, SEND_DATA_TO_HELPER, MPI_COMM_WORLD, &status);
+        MPI_Get_count(&status, MPI_INT, &count);
+        CHECK(count >= REQUEST_SIZE && count % REQUEST_SIZE == 0, STATUS_ERR_UNKNOWN);
+        request.resize(count);
+        MPI_Recv(request.data(), count, MPI_INT, status.MPI_SOURCE, SEND_DATA_TO_HELPER, MPI_COMM_WORLD, &status);
+        for (int pos = 0; pos < count && !is_finished; pos += REQUEST_SIZE) {
+            int* record = request.data() + pos;
+            if (record[0] == -1 && record[1] == -1 && record[2] == -1 && record[3] == -1) {  // окончание работы вспомогательного потока
+                // освобождение памяти
 #if (ENABLE_STATISTICS_COLLECTION)
     #if (ENABLE_STATISTICS_QUANTUMS_CNT_WORKERS)
-            // write quantum request statistic to file
-            std::ofstream worker_process_statistic;
-            worker_process_statistic.open(STATISTICS_OUTPUT_DIRECTORY + "quantums_ranks_cnt_process_" + std::to_string(rank) + ".txt");
-            worker_process_statistic << "key | quantum_index | cnt | mode (READ_ONLY = 0, READ_WRITE = 1)\n";
+                // write quantum request statistic to file
+                std::ofstream worker_process_statistic;
+                worker_process_statistic.open(STATISTICS_OUTPUT_DIRECTORY + "quantums_ranks_cnt_process_" + std::to_string(rank) + ".txt");
+                worker_process_statistic << "key | quantum_index | cnt | mode (READ_ONLY = 0, READ_WRITE = 1, WRITE_SHARED = 2)\n";
     #endif
 #endif
-            for (int key = 0; key < int(memory_manager::memory.size()); ++key) {
+                for (int key = 0; key < int(memory_manager::memory.size()); ++key) {
+                    if (memory_manager::memory[key] == nullptr)  // структура уничтожена
+                        continue;
 #if (ENABLE_STATISTICS_COLLECTION)
     #if (ENABLE_STATISTICS_CACHE_MISSES_CNT)
-                auto* memory = dynamic_cast<memory_line_worker*>(memory_manager::memory[key]);
-                memory->cache.get_cache_miss_cnt_statistics(key, memory->quantums.size() * memory->quantum_size);
+                    auto* memory = memory_manager::memory[key];
+                    memory->cache.get_cache_miss_cnt_statistics(key, memory->quantums.size() * memory->quantum_size);
     #endif
     #if (ENABLE_STATISTICS_QUANTUMS_CNT_WORKERS)
-                for (int quantum_index = 0; quantum_index < memory->quantums.size(); ++quantum_index) {
-                    for (int j = 0; j < memory->quantums[quantum_index].cnt.size(); ++j) {
-                        worker_process_statistic << key << " " << quantum_index << " " << memory->quantums[quantum_index].cnt[j] << " " << memory->quantums[quantum_index].modes[j] << "\n";
+                    for (int quantum_index = 0; quantum_index < memory->quantums.size(); ++quantum_index) {
+                        memory_manager::collect_statistic_worker(key, quantum_index);
+                        for (int j = 0; j < memory->quantums[quantum_index].cnt.size(); ++j) {
+                            worker_process_statistic << key << " " << quantum_index << " " << memory->quantums[quantum_index].cnt[j] << " " << memory->quantums[quantum_index].modes[j] << "\n";
+                        }
                     }
-                }
     #endif
 #endif
-                auto* memory_line = dynamic_cast<memory_line_worker*>(memory_manager::memory[key]);
-                delete memory_line;
-            }
+                    auto* memory_line = memory_manager::memory[key];
+                    delete memory_line;
+                }
 #if (ENABLE_STATISTICS_COLLECTION)
     #if (ENABLE_STATISTICS_QUANTUMS_CNT_WORKERS)
-            worker_process_statistic.close();
+                worker_process_statistic.close();
     #endif
 #endif
-            break;
-        }
-        int key = request[1], quantum_index = request[2], to_rank = request[3];
-        auto* memory = dynamic_cast<memory_line_worker*>(memory_manager::memory[key]);
-        CHECK(key >= 0 && key < (int)memory_manager::memory.size(), STATUS_ERR_OUT_OF_BOUNDS);
-        if (request[0] != PRINT) {
-            CHECK(quantum_index >= 0 && quantum_index < (int)memory->quantums.size(), STATUS_ERR_OUT_OF_BOUNDS);
-            CHECK(memory->quantums[quantum_index].quantum != nullptr, STATUS_ERR_NULLPTR);
-            if (request[0] != DELETE)
-                CHECK(to_rank > 0 && to_rank < size, STATUS_ERR_WRONG_RANK);
-        }
-        // запросы на GET_DATA_R и GET_DATA_RW принимаются только от мастера
-        switch(request[0]) {
-            case GET_DATA_R:  // READ_ONLY режим, запись запрещена, блокировка мьютекса для данного кванта не нужна
-                MPI_Send(memory->quantums[quantum_index].quantum, memory->quantum_size,
-                                        memory->type, to_rank, GET_DATA_FROM_HELPER, MPI_COMM_WORLD);
-                break;
-            case GET_DATA_RW:  // READ_WRITE режим
-                memory->quantums[quantum_index].mutex->lock();
-                MPI_Send(memory->quantums[quantum_index].quantum, memory->quantum_size,
-                                        memory->type, to_rank, GET_DATA_FROM_HELPER, MPI_COMM_WORLD);
-                memory->allocator.free(reinterpret_cast<char**>(&(memory->quantums[quantum_index].quantum)));  // после отправки данных в READ_WRITE режиме квант на данном процессе удаляется
-                memory->quantums[quantum_index].mutex->unlock();
-                break;
-            case PRINT:
-            {
-                int l_quantum_index = request[2], r_quantum_index = request[3];
-                for (int i = l_quantum_index; i < r_quantum_index; ++i)
-                    memory_manager::print_quantum(key, i);
-                int ready = 1;
-                MPI_Send(&ready, 1, MPI_INT, 0, GET_PERMISSION_TO_CONTINUE, MPI_COMM_WORLD);
+                is_finished = true;
                 break;
             }
-            case DELETE:
-            {
-                memory->quantums[quantum_index].mutex->lock();
-                int removing_quantum_index = request[2];
-                memory->allocator.free(reinterpret_cast<char**>(&(memory->quantums[removing_quantum_index].quantum)));
-                memory->quantums[quantum_index].mutex->unlock();
-                break;
+            int key = record[1], quantum_index = record[2], to_rank = record[3], tag = record[4];
+            auto* memory = memory_manager::memory[key];
+            CHECK(key >= 0 && key < (int)memory_manager::memory.size(), STATUS_ERR_OUT_OF_BOUNDS);
+            if (record[0] != PRINT && record[0] != DESTROY) {
+                CHECK(quantum_index >= 0 && quantum_index < (int)memory->quantums.size(), STATUS_ERR_OUT_OF_BOUNDS);
+            }
+            if (record[0] == GET_DATA_R || record[0] == GET_DATA_RW) {
+                CHECK(memory->quantums[quantum_index].quantum != nullptr, STATUS_ERR_NULLPTR);
+                CHECK(to_rank > 0 && to_rank < size, STATUS_ERR_WRONG_RANK);
+            }
+            // запросы на GET_DATA_R и GET_DATA_RW принимаются только от каталога
+            switch(record[0]) {
+                case GET_DATA_R:  // READ_ONLY режим, запись запрещена, блокировка мьютекса для данного кванта не нужна
+                    MPI_Send(memory->quantums[quantum_index].quantum, memory->quantum_size,
+                                            memory->type, to_rank, tag, MPI_COMM_WORLD);
+                    break;
+                case GET_DATA_RW:  // READ_WRITE режим
+                    memory->quantums[quantum_index].mutex->lock();
+                    // квант закреплён или ещё принимается, отправка выполняется при откреплении или по приёме кванта
+                    if (memory->quantums[quantum_index].pins > 0 || (memory->quantums[quantum_index].version->load() & 2)) {
+                        CHECK(memory->quantums[quantum_index].deferred_to_rank == -1, STATUS_ERR_UNKNOWN);
+                        memory->quantums[quantum_index].deferred_to_rank = to_rank;
+                        memory->quantums[quantum_index].deferred_tag = tag;
+                    } else if (memory_manager::is_leased(memory->quantums[quantum_index])) {  // квант остаётся у владельца до окончания аренды
+                        memory->quantums[quantum_index].deferred_to_rank = to_rank;
+                        memory->quantums[quantum_index].deferred_tag = tag;
+                        leased.emplace_back(key, quantum_index);
+                    } else {
+                        memory_manager::send_quantum(key, quantum_index, to_rank, tag);
+                    }
+                    memory->quantums[quantum_index].mutex->unlock();
+                    break;
+                case GET_DATA_HINT:  // READ_ONLY квант запрошен в обход каталога, копия отправляется, только если она на процессе и актуальна
+                {
+                    auto& quantum = memory->quantums[quantum_index];
+                    quantum.mutex->lock();
+                    // память READ_ONLY кванта освобождается только по DELETE, который обрабатывается этим же потоком
+                    bool is_present = quantum.mode == READ_ONLY && !quantum.is_mode_changed && quantum.quantum != nullptr && !(quantum.version->load() & 2);
+                    quantum.mutex->unlock();
+                    MPI_Send(is_present ? quantum.quantum : nullptr, is_present ? memory->quantum_size : 0, memory->type, to_rank, tag, MPI_COMM_WORLD);
+                    break;
+                }
+                case PRINT:
+                {
+                    int l_quantum_index = record[2], r_quantum_index = record[3];
+                    for (int i = l_quantum_index; i < r_quantum_index; ++i)
+                        memory_manager::print_quantum(key, i);
+                    int ready = 1;
+                    MPI_Send(&ready, 1, MPI_INT, status.MPI_SOURCE, PRINT_FINISHED, MPI_COMM_WORLD);  // ответ части каталога, запросившей печать
+                    break;
+                }
+                case DELETE:
+                {
+                    memory->quantums[quantum_index].mutex->lock();
+                    if (memory->quantums[quantum_index].is_removing) {  // иначе квант после вытеснения снова запрошен и память используется
+                        if (memory->quantums[quantum_index].pins > 0) {  // вытесненный квант закреплён представлением
+                            memory->quantums[quantum_index].is_delete_deferred = true;
+                        } else {
+                            memory_manager::free_removed(key, quantum_index);
+                        }
+                    }
+                    memory->quantums[quantum_index].mutex->unlock();
+                    break;
+                }
+                case DESTROY:  // часть каталога больше не обращается к структуре, память освобождает поток вычислений
+                {
+                    // запросы, отложенные до окончания аренды, выполнены: процессы, ждавшие кванты, уже вызвали destroy_object
+                    leased.erase(std::remove_if(leased.begin(), leased.end(), [&](const std::pair<int, int>& q) { return q.first == key; }), leased.end());
+                    int done = 1;
+                    MPI_Send(&done, 1, MPI_INT, rank, OBJECT_DESTROYED, MPI_COMM_WORLD);
+                    break;
+                }
+                case ACCUMULATE:
+                case FETCH_AND_OP:
+                case DIFF:
+                {
+                    auto& quantum = memory->quantums[quantum_index];
+                    int length = (1 + memory_manager::get_payload_records(record)) * REQUEST_SIZE;
+                    quantum.mutex->lock();
+                    if (quantum.version->load() & 2) {  // квант ещё принимается, операция выполняется по его приёме
+                        quantum.deferred_accumulates.insert(quantum.deferred_accumulates.end(), record, record + length);
+                    } else {
+                        memory_manager::apply_accumulate(key, record, acks);
+                    }
+                    quantum.mutex->unlock();
+                    pos += length - REQUEST_SIZE;
+                    break;
+                }
             }
         }
+        memory_manager::send_accumulate_acks(acks);
     }
 }
 
-void master_helper_thread() {
-    int request[4] = {-2, -2, -2, -2};
+void master_helper_thread(int thread_index) {
+    std::vector<int> request(REQUEST_SIZE, -2);
+    std::vector<int> reply;  // ответы на запросы TRY_GET_INFO, отправляемые одним сообщением
     MPI_Status status;
     int rank, size;
     MPI_Comm_rank(MPI_COMM_WORLD, &rank);
     MPI_Comm_size(MPI_COMM_WORLD, &size);
+    int tag = SEND_DATA_TO_MASTER_HELPER + thread_index;
+    memory_manager::to_helpers.resize(size);
 
 #if (ENABLE_STATISTICS_COLLECTION)
+    std::string suffix = (thread_index == 0) ? "" : "_" + std::to_string(thread_index);  // файлы статистики потока каталога
   #if (ENABLE_STATISTICS_QUANTUMS_SCHEDULE)
     std::ofstream quantums_schedule_file_stream;
-    quantums_schedule_file_stream.open(STATISTICS_OUTPUT_DIRECTORY + "quantums_schedule_raw" + ".txt");
+    quantums_schedule_file_stream.open(STATISTICS_OUTPUT_DIRECTORY + "quantums_schedule_raw_" + std::to_string(rank) + suffix + ".txt");
   #endif
 #endif
-    while (true) {
-        MPI_Recv(&request, 4, MPI_INT, MPI_ANY_SOURCE, SEND_DATA_TO_MASTER_HELPER, MPI_COMM_WORLD, &status);
-        if (request[0] == -1 && request[1] == -1 && request[2] == -1) {  // окончание работы вспомогательного потока
-            for (auto _line: memory_manager::memory) {
-                memory_line_master* line = dynamic_cast<memory_line_master*>(_line);
-                for (auto quantum: line->quantums) {
-                    for (int i = 0; i < size - 1; ++i) {
-                        CHECK(quantum.requests[i] == 0, STATUS_ERR_UNKNOWN);
-                    }
-                }
-                delete _line;
-            }
-            break;
+    // смена режима не требует ответа каталога: процесс, приславший CHANGE_MODE, продолжает работу, а его следующие посылки
+    // по структуре откладываются, пока CHANGE_MODE не пришлют все процессы, и обрабатываются в порядке поступления
+    std::deque<std::pair<int, std::vector<int>>> deferred;
+    auto is_deferred = [&](int source, const std::vector<int>& message) {
+        for (int pos = 0; pos < (int)message.size(); pos += REQUEST_SIZE) {
+            const int* record = message.data() + pos;
+            if (record[0] == -1 && record[1] == -1 && record[2] == -1)
+                continue;
+            CHECK(record[1] >= 0 && record[1] < (int)memory_manager::directory.size(), STATUS_ERR_OUT_OF_BOUNDS);
+            if (memory_manager::directory[record[1]]->changed_mode_procs[source - 1])
+                return true;
+            pos += memory_manager::get_payload_records(record) * REQUEST_SIZE;
         }
-        int key = request[1], quantum_index = request[2];
-        memory_line_master* memory;
-        memory = dynamic_cast<memory_line_master*>(memory_manager::memory[key]);
-        CHECK(key >= 0 && key < (int)memory_manager::memory.size(), STATUS_ERR_OUT_OF_BOUNDS);
-        if (request[0] != PRINT) {
-            CHECK(quantum_index >= 0 && quantum_index < (int)memory->quantums.size(), STATUS_ERR_OUT_OF_BOUNDS);
-        }
-        switch(request[0]) {
-            case LOCK:  // блокировка кванта
-                if (memory->quantums[quantum_index].quantum_lock_number == -1) {  // квант не заблокирован
-                    int to_rank = status.MPI_SOURCE;
-                    int tmp = 1;
-                    memory->quantums[quantum_index].quantum_lock_number = status.MPI_SOURCE;
-                    MPI_Send(&tmp, 1, MPI_INT, to_rank, GET_DATA_FROM_MASTER_HELPER_LOCK, MPI_COMM_WORLD);  // уведомление о том,
-                                                                                                            // что процесс может заблокировать квант
-                } else {  // квант уже заблокирован другим процессом, данный процесс помещается в очередь ожидания по данному кванту
-                    memory->wait_locks.push(quantum_index, status.MPI_SOURCE);
-                }
+        return false;
+    };
+    int finished_workers = 0;  // число рабочих, завершивших работу
+    while (finished_workers < memory_manager::worker_size) {
+        // посылка состоит из одной или нескольких записей по REQUEST_SIZE int
+        int count = 0, source = -1;
+        // сначала обрабатываются отложенные посылки, которые больше не нужно откладывать; посылки процесса не обгоняют друг друга
+        std::vector<bool> is_waiting(size, false);
+        for (auto it = deferred.begin(); it != deferred.end(); ++it) {
+            if (!is_waiting[it->first] && !is_deferred(it->first, it->second)) {
+                source = it->first;
+                request.swap(it->second);
+                deferred.erase(it);
                 break;
-            case UNLOCK:  // разблокировка кванта
-                if (memory->quantums[quantum_index].quantum_lock_number == status.MPI_SOURCE) {
-                    memory->quantums[quantum_index].quantum_lock_number = -1;
-                    if (memory->wait_locks.is_contain(quantum_index)) {  // проверка, есть ли в очереди ожидания по данному кванту какой-либо процесс
-                        int to_rank = memory->wait_locks.pop(quantum_index);
-                        memory->quantums[quantum_index].quantum_lock_number = to_rank;
+            }
+            is_waiting[it->first] = true;
+        }
+        if (source == -1) {
+            MPI_Probe(MPI_ANY_SOURCE, tag, MPI_COMM_WORLD, &status);
+            MPI_Get_count(&status, MPI_INT, &count);
+            CHECK(count >= REQUEST_SIZE && count % REQUEST_SIZE == 0, STATUS_ERR_UNKNOWN);
+            request.resize(count);
+            MPI_Recv(request.data(), count, MPI_INT, status.MPI_SOURCE, tag, MPI_COMM_WORLD, &status);
+            source = status.MPI_SOURCE;
+            if (is_waiting[source] || is_deferred(source, request)) {
+                deferred.emplace_back(source, request);
+                continue;
+            }
+        }
+        count = int(request.size());
+        reply.clear();
+        for (int pos = 0; pos < count; pos += REQUEST_SIZE) {
+            int* record = request.data() + pos;
+            if (record[0] == -1 && record[1] == -1 && record[2] == -1) {  // рабочий завершил работу, других записей от него не будет
+                ++finished_workers;
+                continue;
+            }
+            int key = record[1], quantum_index = record[2];
+            CHECK(key >= 0 && key < (int)memory_manager::directory.size(), STATUS_ERR_OUT_OF_BOUNDS);
+            CHECK(memory_manager::get_master_helper(key) == thread_index, STATUS_ERR_UNKNOWN);
+            memory_line_master* memory = memory_manager::directory[key];
+            int first_quantum_index = memory->first_quantum_index;
+            int local_index = quantum_index - first_quantum_index;  // номер кванта в данной части каталога
+            if (record[0] != PRINT && record[0] != CHANGE_MODE && record[0] != DESTROY) {
+                CHECK(local_index >= 0 && local_index < (int)memory->quantums.size(), STATUS_ERR_OUT_OF_BOUNDS);
+            }
+            switch(record[0]) {
+                case LOCK:  // блокировка кванта, record[3] - тег ответа ожидающего потока
+                    if (memory->quantums[local_index].quantum_lock_number == -1) {  // квант не заблокирован
                         int tmp = 1;
-                        MPI_Send(&tmp, 1, MPI_INT, to_rank, GET_DATA_FROM_MASTER_HELPER_LOCK, MPI_COMM_WORLD);  // уведомление о том, что процесс, изъятый
-                                                                                                                // из очереди, может заблокировать квант
-                    }
-                }
-                break;
-            case GET_INFO:  // получить квант
-                if (memory->quantums[quantum_index].mode == READ_ONLY) {
-                    if (memory->quantums[quantum_index].is_mode_changed) {  // был переход между режимами?
-                        CHECK(!memory->quantums[quantum_index].owners.empty(), STATUS_ERR_READ_UNINITIALIZED_DATA);  // квант не был инициализирован
-                        CHECK(memory->quantums[quantum_index].quantum_ready == true, STATUS_ERR_UNKNOWN);
-                        CHECK(memory->quantums[quantum_index].owners.size() == 1, STATUS_ERR_UNKNOWN);
-                        memory->quantums[quantum_index].is_mode_changed = false;
-                        int to_rank = memory->quantums[quantum_index].owners.front();
-                        if (to_rank == status.MPI_SOURCE) {  // после перехода оказалось, что квант находится на процессе, который отправил запрос?
-                            // do smth with cache?
-                            MPI_Send(&to_rank, 1, MPI_INT, status.MPI_SOURCE, GET_INFO_FROM_MASTER_HELPER, MPI_COMM_WORLD);
-                            break;
-                        }
+                        memory->quantums[local_index].quantum_lock_number = source;
+                        MPI_Send(&tmp, 1, MPI_INT, source, record[3], MPI_COMM_WORLD);  // уведомление о том, что процесс может заблокировать квант
+                    } else {  // квант уже заблокирован другим процессом, данный процесс помещается в очередь ожидания по данному кванту
+                        memory->wait_locks.push(local_index, source, record[3]);
                     }
-                    CHECK(!memory->quantums[quantum_index].owners.empty(), STATUS_ERR_READ_UNINITIALIZED_DATA);  // квант не был инициализирован
-
-                    int to_rank = memory_manager::get_owner(key, quantum_index, status.MPI_SOURCE);  // получение ранга наиболее предпочтительного процесса
-                    CHECK(to_rank > 0 && to_rank < size, STATUS_ERR_WRONG_RANK);
-
-                    int to_request[4] = {GET_DATA_R, key, quantum_index, status.MPI_SOURCE};
-                    MPI_Send(&to_rank, 1, MPI_INT, status.MPI_SOURCE, GET_INFO_FROM_MASTER_HELPER, MPI_COMM_WORLD);  // отправление информации о том, с каким процессом
-                                                                                                                     // нужно взаимодействовать для получения кванта
-                    if (to_rank != status.MPI_SOURCE) {
-                        CHECK(to_rank < size, STATUS_ERR_OUT_OF_BOUNDS);
-                        ++memory->quantums[quantum_index].requests[to_rank - 1];
-                        MPI_Send(to_request, 4, MPI_INT, to_rank, SEND_DATA_TO_HELPER, MPI_COMM_WORLD);  // отправление запроса вспомогательному потоку
-                                                                                                         // процесса-рабочего о переслыке данных
-                    }
-
-                    // работа с кешем
-                    int removing_quantum_index = request[3];
-                    if (removing_quantum_index >= 0) {
-                        memory_manager::remove_owner(key, removing_quantum_index, status.MPI_SOURCE);
-                        // нет необработанных запросов на передачу данного кванта с данного процесса?
-                        if (memory->quantums[removing_quantum_index].requests[status.MPI_SOURCE] == 0) {
-                            int request_to_delete[] = {DELETE, key, removing_quantum_index, -1};
-                            MPI_Send(request_to_delete, 4, MPI_INT, status.MPI_SOURCE, SEND_DATA_TO_HELPER, MPI_COMM_WORLD);
-                        } else {
-                            memory->quantums[removing_quantum_index].want_to_delete[status.MPI_SOURCE] = true;
-                        }
-                    }
-
-                } else {  // READ_WRITE mode
-                    if (memory->quantums[quantum_index].is_mode_changed) {  // был переход между режимами?
-                        int to_rank = memory_manager::get_owner(key, quantum_index, status.MPI_SOURCE);  // получение ранга наиболее предпочтительного процесса
-                        memory->quantums[quantum_index].is_mode_changed = false;
-                        while (memory->quantums[quantum_index].owners.size())
-                            memory->quantums[quantum_index].owners.pop_front();  // TODO: send to all quantums to free memory?
-                        memory->quantums[quantum_index].quantum_ready = false;
-                        memory->quantums[quantum_index].owners.push_back(status.MPI_SOURCE);
-                        if (to_rank == -1 || to_rank == status.MPI_SOURCE) {  // данные у процесса, отправившего запрос?
-                            MPI_Send(&status.MPI_SOURCE, 1, MPI_INT, status.MPI_SOURCE, GET_INFO_FROM_MASTER_HELPER, MPI_COMM_WORLD);
-                        } else {
-                            CHECK(to_rank < size, STATUS_ERR_OUT_OF_BOUNDS);
-                            ++memory->quantums[quantum_index].requests[to_rank - 1];
-                            int to_request[4] = {GET_DATA_RW, key, quantum_index, status.MPI_SOURCE};
-                            MPI_Send(&to_rank, 1, MPI_INT, status.MPI_SOURCE, GET_INFO_FROM_MASTER_HELPER, MPI_COMM_WORLD);  // отправление информации о том, с каким процессом
-                                                                                                                             // нужно взаимодействовать для получения кванта
-                            MPI_Send(to_request, 4, MPI_INT, to_rank, SEND_DATA_TO_HELPER, MPI_COMM_WORLD);  // отправление запроса вспомогательному потоку
-                                                                                                             // процесса-рабочего о переслыке данных
+                    break;
+                case UNLOCK:  // разблокировка кванта
+                    if (memory->quantums[local_index].quantum_lock_number == source) {
+                        memory->quantums[local_index].quantum_lock_number = -1;
+                        if (memory->wait_locks.is_contain(local_index)) {  // проверка, есть ли в очереди ожидания по данному кванту какой-либо процесс
+                            waiting_process next = memory->wait_locks.pop(local_index);
+                            memory->quantums[local_index].quantum_lock_number = next.process;
+                            int tmp = 1;
+                            MPI_Send(&tmp, 1, MPI_INT, next.process, next.reply_tag, MPI_COMM_WORLD);  // уведомление о том, что процесс, изъятый
+                                                                                                        // из очереди, может заблокировать квант
                         }
-                        break;
                     }
-
-                    if (memory->quantums[quantum_index].owners.empty()) {  // данные ранее не запрашивались?
-                        memory->quantums[quantum_index].quantum_ready = false;
-                        memory->quantums[quantum_index].owners.push_back(status.MPI_SOURCE);
-                        MPI_Send(&status.MPI_SOURCE, 1, MPI_INT, status.MPI_SOURCE, GET_INFO_FROM_MASTER_HELPER, MPI_COMM_WORLD);  // отправление информации о том, что процесс,
-                                                                                                                                   // отправивший запрос, может забрать квант без
-                                                                                                                                   // пересылок данных
-                        break;
-                    }  // empty
-
-                    if (memory->quantums[quantum_index].quantum_ready) {  // данные готовы к пересылке?
-                        CHECK(memory->quantums[quantum_index].owners.size() == 1, STATUS_ERR_UNKNOWN);
-                        int to_rank = memory->quantums[quantum_index].owners.front();
-                        int to_request[4] = {GET_DATA_RW, key, quantum_index, status.MPI_SOURCE};
-                        memory->quantums[quantum_index].quantum_ready = false;
-                        memory->quantums[quantum_index].owners.pop_front();
-                        memory->quantums[quantum_index].owners.push_back(status.MPI_SOURCE);
-
-                        CHECK(to_rank < size, STATUS_ERR_OUT_OF_BOUNDS);
-                        ++memory->quantums[quantum_index].requests[to_rank - 1];
-                        MPI_Send(&to_rank, 1, MPI_INT, status.MPI_SOURCE, GET_INFO_FROM_MASTER_HELPER, MPI_COMM_WORLD);  // отправление информации о том, с каким процессом
-                                                                                                                         // нужно взаимодействовать для получения кванта
-                        MPI_Send(to_request, 4, MPI_INT, to_rank, SEND_DATA_TO_HELPER, MPI_COMM_WORLD);  // отправление запроса вспомогательному потоку
-                                                                                                         // процесса-рабочего о переслыке данных
-                    } else {  // данные не готовы к пересылке (в данный момент пересылаются другому процессу)
-                        memory->wait_quantums.push(quantum_index, status.MPI_SOURCE);
+                    break;
+                case GET_INFO:  // получить квант
+                case GET_GRANT:  // получить квант в READ_WRITE режиме вместе с правом владения
+                {
+                    CHECK(record[0] == GET_INFO || memory->quantums[local_index].mode == READ_WRITE, STATUS_ERR_UNKNOWN);
+                    int to_reply[REPLY_SIZE] = {-1, -1};
+                    to_reply[0] = memory_manager::handle_get_info(key, quantum_index, source, record[4], to_reply[1]);
+                    if (record[0] == GET_INFO || to_reply[0] == source) {  // иначе ответом служит квант, пересланный владельцем
+                        MPI_Send(to_reply, REPLY_SIZE, MPI_INT, source, record[3], MPI_COMM_WORLD);  // отправление информации о том, с каким процессом
+                                                                                                                // нужно взаимодействовать для получения кванта
                     }
+                    break;
                 }
-                break;
-            case SET_INFO:  // данные готовы для пересылки
-            {
-                int worker_rank_sender = request[3] - 1;
-                if (worker_rank_sender >= 0) {
-                    CHECK(worker_rank_sender < size - 1, STATUS_ERR_OUT_OF_BOUNDS);
-                    // уменьшить счётчик для кванта и процесса, посылавшего квант на процесс status.MPI_SOURCE
-                    --memory->quantums[quantum_index].requests[worker_rank_sender];
-                    CHECK(memory->quantums[quantum_index].requests[worker_rank_sender] >= 0, STATUS_ERR_UNKNOWN);
-                    // для данного процесса и кванта незаконченных запросов не осталось?
-                    if (memory->quantums[quantum_index].requests[worker_rank_sender] == 0 &&
-                                memory->quantums[quantum_index].want_to_delete[worker_rank_sender]) {
-
-                        memory->quantums[quantum_index].want_to_delete[worker_rank_sender] = false;
-                        int request_to_delete[] = {DELETE, key, quantum_index, 0};
-                        MPI_Send(request_to_delete, 4, MPI_INT, worker_rank_sender, SEND_DATA_TO_HELPER, MPI_COMM_WORLD);
-                    }
+                case ACCUMULATE:  // операция над элементом выполняется владельцем кванта
+                case FETCH_AND_OP:
+                {
+                    auto& quantum = memory->quantums[local_index];
+                    CHECK(quantum.mode == READ_WRITE, STATUS_ERR_ILLEGAL_WRITE);
+                    // процесс после смены режима сначала забирает квант к себе, поэтому владелец известен
+                    CHECK(!quantum.is_mode_changed, STATUS_ERR_UNKNOWN);
+                    CHECK(!quantum.owners.empty(), STATUS_ERR_READ_UNINITIALIZED_DATA);  // квант не был инициализирован
+                    int length = (1 + memory_manager::get_payload_records(record)) * REQUEST_SIZE;
+                    auto& to_owner = memory_manager::to_helpers[quantum.owners.front()];
+                    to_owner.insert(to_owner.end(), record, record + length);  // запись вместе с данными пересылается владельцу
+                    pos += length - REQUEST_SIZE;
+                    break;
                 }
-
-                if (memory->quantums[quantum_index].mode == READ_ONLY) {
-                    memory->quantums[quantum_index].owners.push_back(status.MPI_SOURCE); // процесс помещается в вектор процессов,
-                                                                                 // которые могут пересылать данный квант другим процессам
-                } else {  // READ_WRITE mode
-                    CHECK(memory->quantums[quantum_index].owners.front() == status.MPI_SOURCE, STATUS_ERR_UNKNOWN);
-                    CHECK(memory->quantums[quantum_index].quantum_ready == false, STATUS_ERR_UNKNOWN);
-                    memory->quantums[quantum_index].quantum_ready = true;
-                    if (memory->wait_quantums.is_contain(quantum_index)) {  // есть процессы, ожидающие готовности кванта?
-                        int source_rank = memory->wait_quantums.pop(quantum_index);
-                        int to_rank = memory->quantums[quantum_index].owners.front();
-                        memory->quantums[quantum_index].quantum_ready = false;
-                        CHECK(memory->quantums[quantum_index].owners.size() == 1, STATUS_ERR_UNKNOWN);
-                        memory->quantums[quantum_index].owners.pop_front();
-                        memory->quantums[quantum_index].owners.push_back(source_rank);
-                        int to_request[4] = {GET_DATA_RW, key, quantum_index, source_rank};
-                        CHECK(source_rank != to_rank, STATUS_ERR_WRONG_RANK);
-                        CHECK(to_rank > 0 && to_rank < size, STATUS_ERR_WRONG_RANK);
-
-                        CHECK(to_rank < size, STATUS_ERR_OUT_OF_BOUNDS);
-                        ++memory->quantums[quantum_index].requests[to_rank - 1];
-                        MPI_Send(&to_rank, 1, MPI_INT, source_rank, GET_INFO_FROM_MASTER_HELPER, MPI_COMM_WORLD);  // отправление информации о том, с каким процессом
-                                                                                                                   // нужно взаимодействовать для получения кванта
-                        MPI_Send(to_request, 4, MPI_INT, to_rank, SEND_DATA_TO_HELPER, MPI_COMM_WORLD);  // отправление запроса вспомогательному потоку
-                                                                                                         // процесса-рабочего о переслыке данных
-                    }
+                case DIFF:  // изменённые элементы копии записываются в квант владельца
+                {
+                    auto& quantum = memory->quantums[local_index];
+                    CHECK(quantum.mode == WRITE_SHARED, STATUS_ERR_ILLEGAL_WRITE);
+                    CHECK(quantum.owners.size() == 1, STATUS_ERR_UNKNOWN);  // копию процесс получил от владельца
+                    int length = (1 + memory_manager::get_payload_records(record)) * REQUEST_SIZE;
+                    auto& to_owner = memory_manager::to_helpers[quantum.owners.front()];
+                    to_owner.insert(to_owner.end(), record, record + length);
+                    pos += length - REQUEST_SIZE;
+                    break;
                 }
-#if (ENABLE_STATISTICS_COLLECTION)
-  #if (ENABLE_STATISTICS_QUANTUMS_SCHEDULE)
-                std::string info = std::to_string(key) + " " + std::to_string(quantum_index) + " " + std::to_string(status.MPI_SOURCE);
-                quantums_schedule_file_stream << info << "\n";
-  #endif
-#endif
-                break;
-            }
-            case CHANGE_MODE:  // изменить режим работы с памятью
-            {
-                int quantum_l = request[2], quantum_r = request[3];
-                ++memory->quantums[quantum_l].num_of_changed_mode_procs;
-                if (memory->quantums[quantum_l].num_of_changed_mode_procs == memory_manager::worker_size) {  // все процессы дошли до этапа изменения режима?
-                    int ready = 1;
-                    for (int i = 1; i < size; ++i) {
-                        MPI_Send(&ready, 1, MPI_INT, i, GET_PERMISSION_FOR_CHANGE_MODE, MPI_COMM_WORLD);  // информирование о смене режима и о том, что
-                                                                                                          // другие процессы могут продолжить выполнение программы дальше
+                case TRY_GET_INFO:  // получить квант, ответ отправляется одним сообщением на всю посылку
+                {
+                    int slot = -1;
+                    reply.push_back(memory_manager::handle_get_info(key, quantum_index, source, record[4], slot));
+                    reply.push_back(slot);
+                    break;
+                }
+                case EVICT:  // работа с кешем
+                {
+                    int process = source;
+                    memory_manager::remove_owner(key, quantum_index, process);
+                    // нет необработанных запросов на передачу данного кванта с данного процесса?
+                    if (memory->quantums[local_index].requests[process - 1] == 0) {
+                        memory_manager::post_helper_request(process, {DELETE, key, quantum_index, -1, -1});
+                    } else {
+                        memory->quantums[local_index].want_to_delete[process - 1] = true;
                     }
-                    memory->quantums[quantum_l].num_of_changed_mode_procs = 0;
-                    for (int i = quantum_l; i < quantum_r; ++i) {
-                        memory->quantums[i].is_mode_changed = true;
-                        if (memory->quantums[i].mode == READ_ONLY) {
-                            memory->quantums[i].mode = READ_WRITE;
-                        } else {
-                            memory->quantums[i].mode = READ_ONLY;
+                    break;
+                }
+                case SET_INFO:  // данные готовы для пересылки
+                {
+                    memory_manager::handle_set_info(key, quantum_index, record[3], source, record[4]);
+    #if (ENABLE_STATISTICS_COLLECTION)
+      #if (ENABLE_STATISTICS_QUANTUMS_SCHEDULE)
+                    std::string info = std::to_string(key) + " " + std::to_string(quantum_index) + " " + std::to_string(source);
+                    quantums_schedule_file_stream << info << "\n";
+      #endif
+    #endif
+                    break;
+                }
+                case CHANGE_MODE:  // изменить режим работы с памятью
+                {
+                    // в данной части каталога меняется режим квантов [quantum_l, quantum_r), счётчик хранится в первом из них
+                    int last_quantum_index = first_quantum_index + (int)memory->quantums.size();
+                    int quantum_l = std::max(record[2], first_quantum_index), quantum_r = std::min(record[3], last_quantum_index);
+                    auto& counter = memory->quantums[std::min(quantum_l, last_quantum_index - 1) - first_quantum_index];
+                    ++counter.num_of_changed_mode_procs;
+                    memory->is_replicate = memory->is_replicate || record[4] % 2 == 1;
+                    memory->changed_mode_procs[source - 1] = true;
+                    if (counter.num_of_changed_mode_procs == memory_manager::worker_size) {  // все процессы дошли до этапа изменения режима?
+                        counter.num_of_changed_mode_procs = 0;
+                        memory->changed_mode_procs.assign(memory_manager::worker_size, false);
+                        for (int i = quantum_l - first_quantum_index; i < quantum_r - first_quantum_index; ++i) {
+                            auto& quantum = memory->quantums[i];
+                            quantum.is_mode_changed = true;
+                            quantum.mode = record[4] / 2;
+                            // в WRITE_SHARED режиме копии раздаёт и изменения принимает один владелец, копии READ_ONLY режима одинаковы
+                            if (quantum.mode == WRITE_SHARED && quantum.owners.size() > 1) {
+                                quantum.owners.resize(1);
+                            }
+                        }
+                        // процессы, запросившие копии, ждут владельцев квантов, -1 - квант не инициализирован или
+                        // после прошлого READ_ONLY режима не записывался и уже имеет копии
+                        if (memory->is_replicate && quantum_l < quantum_r) {
+                            std::vector<int> owners;
+                            for (int i = quantum_l - first_quantum_index; i < quantum_r - first_quantum_index; ++i) {
+                                auto& quantum = memory->quantums[i];
+                                bool is_initialized = quantum.mode == READ_ONLY && quantum.quantum_ready && quantum.owners.size() == 1;
+                                owners.push_back(is_initialized ? quantum.owners.front() : -1);
+                            }
+                            for (int i = 1; i < size; ++i) {
+                                MPI_Send(owners.data(), int(owners.size()), MPI_INT, i, GET_PERMISSION_FOR_CHANGE_MODE, MPI_COMM_WORLD);
+                            }
                         }
+                        memory->is_replicate = false;
+    #if (ENABLE_STATISTICS_COLLECTION)
+      #if (ENABLE_STATISTICS_QUANTUMS_SCHEDULE)
+                    std::string info = std::to_string(key) + " " + "CHANGE_MODE " + std::to_string(record[2]) + " " + std::to_string(record[3]);
+                    quantums_schedule_file_stream << info << "\n";
+      #endif
+    #endif
                     }
-#if (ENABLE_STATISTICS_COLLECTION)
-  #if (ENABLE_STATISTICS_QUANTUMS_SCHEDULE)
-                std::string info = std::to_string(key) + " " + "CHANGE_MODE " + std::to_string(quantum_l) + " " + std::to_string(quantum_r);
-                quantums_schedule_file_stream << info << "\n";
-  #endif
-#endif
+                    break;
                 }
-                break;
-            }
-            case PRINT:
-            {
-                ++memory_manager::proc_count_ready;
-                if (memory_manager::proc_count_ready == memory_manager::worker_size) {
-                    int l_quantum_index = 0, r_quantum_index = 0;
-                    memory_manager::proc_count_ready = 0;
-                    std::set<int>s1, s2;
-                    while (l_quantum_index < (int)memory->quantums.size()) {
-                        if (r_quantum_index < (int)memory->quantums.size()) {
-                            CHECK(memory->quantums[r_quantum_index].quantum_ready, STATUS_ERR_NULLPTR);
+                case DESTROY:  // записи рабочих по структуре, отправленные до DESTROY, уже обработаны
+                {
+                    if (++memory->num_of_destroyed_procs == memory_manager::worker_size) {
+                        for (auto& quantum: memory->quantums) {
+                            for (int i = 0; i < size - 1; ++i) {
+                                CHECK(quantum.requests[i] == 0, STATUS_ERR_UNKNOWN);
+                            }
                         }
-                        if (s1.empty()) {
-                            for (auto proc: memory->quantums[r_quantum_index].owners)
-                                s1.insert(proc);
-                            ++r_quantum_index;
-                            continue;
-                        } else {
-                            if (r_quantum_index < (int)memory->quantums.size())
+                        delete memory;
+                        memory_manager::directory[key] = nullptr;
+                        for (int i = 1; i < size; ++i) {
+                            memory_manager::post_helper_request(i, {DESTROY, key, -1, -1, -1});
+                        }
+                    }
+                    break;
+                }
+                case PRINT:
+                {
+                    ++memory_manager::proc_count_ready;
+                    if (memory_manager::proc_count_ready == memory_manager::worker_size) {
+                        // кванты данной части каталога печатаются группами, целиком хранящимися на одном процессе
+                        int l_quantum_index = 0, r_quantum_index = 0;
+                        memory_manager::proc_count_ready = 0;
+                        std::set<int>s1, s2;
+                        while (l_quantum_index < (int)memory->quantums.size()) {
+                            if (r_quantum_index < (int)memory->quantums.size()) {
+                                CHECK(memory->quantums[r_quantum_index].quantum_ready, STATUS_ERR_NULLPTR);
+                            }
+                            if (s1.empty()) {
                                 for (auto proc: memory->quantums[r_quantum_index].owners)
-                                    if (s1.find(proc) != s1.end())
-                                        s2.insert(proc);
-                            if (s2.size() > 0) {
-                                s1 = s2;
-                                s2.clear();
+                                    s1.insert(proc);
                                 ++r_quantum_index;
+                                continue;
                             } else {
-                                int request[4] = {PRINT, key, l_quantum_index, r_quantum_index};  // [l, r)
-                                int to_rank = *s1.begin();
-                                MPI_Send(request, 4, MPI_INT, to_rank, SEND_DATA_TO_HELPER, MPI_COMM_WORLD);
-                                s1.clear();
-                                l_quantum_index = r_quantum_index;
-                                int ready;
-                                MPI_Status status;
-                                MPI_Recv(&ready, 1, MPI_INT, to_rank, GET_PERMISSION_TO_CONTINUE, MPI_COMM_WORLD, &status);  // TODO: IRecv
+                                if (r_quantum_index < (int)memory->quantums.size())
+                                    for (auto proc: memory->quantums[r_quantum_index].owners)
+                                        if (s1.find(proc) != s1.end())
+                                            s2.insert(proc);
+                                if (s2.size() > 0) {
+                                    s1 = s2;
+                                    s2.clear();
+                                    ++r_quantum_index;
+                                } else {
+                                    int to_rank = *s1.begin();
+                                    memory_manager::post_helper_request(to_rank, {PRINT, key, first_quantum_index + l_quantum_index,
+                                                                                  first_quantum_index + r_quantum_index, -1});  // [l, r)
+                                    memory_manager::flush_helper_requests();
+                                    s1.clear();
+                                    l_quantum_index = r_quantum_index;
+                                    int ready;
+                                    MPI_Status status;
+                                    MPI_Recv(&ready, 1, MPI_INT, to_rank, PRINT_FINISHED, MPI_COMM_WORLD, &status);  // TODO: IRecv
+                                }
                             }
                         }
+                        int ready = 1;
+                        for (int i = 1; i < size; ++i) {
+                            MPI_Send(&ready, 1, MPI_INT, i, GET_PERMISSION_TO_CONTINUE, MPI_COMM_WORLD);
+                        }
                     }
-                    int ready = 1;
-                    for (int i = 1; i < size; ++i) {
-                        MPI_Send(&ready, 1, MPI_INT, i, GET_PERMISSION_TO_CONTINUE, MPI_COMM_WORLD);
-                    }
+                    break;
                 }
-                break;
+                }
+        }
+        if (!reply.empty()) {
+            MPI_Send(reply.data(), int(reply.size()), MPI_INT, source, GET_INFO_FROM_MASTER_HELPER, MPI_COMM_WORLD);
+        }
+        memory_manager::flush_helper_requests();  // запросы, порождённые посылкой, отправляются одной посылкой каждому рабочему
+    }
+#if (ENABLE_STATISTICS_COLLECTION)
+  #if (ENABLE_STATISTICS_MIGRATIONS_CNT)
+    std::ofstream migrations_statistic;
+    migrations_statistic.open(STATISTICS_OUTPUT_DIRECTORY + "quantums_migrations_" + std::to_string(rank) + suffix + ".txt");
+    migrations_statistic << "key | quantum_index | migrations\n";
+  #endif
+#endif
+    // освобождение памяти структур, обслуживаемых данным потоком
+    for (int key = thread_index; key < (int)memory_manager::directory.size(); key += NUMBER_OF_MASTER_HELPERS) {
+        auto* line = memory_manager::directory[key];
+        if (line == nullptr)  // структура уничтожена
+            continue;
+        for (int local_index = 0; local_index < (int)line->quantums.size(); ++local_index) {
+            auto& quantum = line->quantums[local_index];
+            for (int i = 0; i < size - 1; ++i) {
+                CHECK(quantum.requests[i] == 0, STATUS_ERR_UNKNOWN);
             }
+#if (ENABLE_STATISTICS_COLLECTION)
+  #if (ENABLE_STATISTICS_MIGRATIONS_CNT)
+            migrations_statistic << key << " " << line->first_quantum_index + local_index << " " << quantum.migrations << "\n";
+  #endif
+#endif
         }
+        delete line;
     }
 #if (ENABLE_STATISTICS_COLLECTION)
   #if (ENABLE_STATISTICS_QUANTUMS_SCHEDULE)
@@ -437,77 +680,1178 @@ void master_helper_thread() {
 }
 
 void memory_manager::set_lock(int key, int quantum_index) {
-    int request[] = {LOCK, key, quantum_index};
-    MPI_Send(request, 3, MPI_INT, 0, SEND_DATA_TO_MASTER_HELPER, MPI_COMM_WORLD);  // отправление мастеру запроса о блокировке кванта
+    // блокировка действует и между потоками процесса: каталог различает только процессы
+    offline_scope offline;
+    memory[key]->quantums[quantum_index].local_lock->lock();
+    int home = get_home(key, quantum_index), slot = -1;
+    {
+        std::lock_guard<std::recursive_mutex> lock(compute_mutex);
+        wait_all_pending();
+        for (int i = 0; i < MAX_LOCK_WAITERS && slot == -1; i++)
+            if (!lock_waiters[i])
+                slot = i;
+        CHECK(slot != -1, STATUS_ERR_UNKNOWN);
+        lock_waiters[slot] = true;
+        post_request(home, {LOCK, key, quantum_index, GET_LOCK_FROM_MASTER_HELPER + slot, -1});  // отправление каталогу запроса о блокировке кванта
+        flush_requests();
+    }
+    // разрешение ожидается вне compute_mutex: его владелец может ждать каталога, который ждёт unset_lock от потоков данного процесса
     int ans;
-    MPI_Status status;
-    MPI_Recv(&ans, 1, MPI_INT, 0, GET_DATA_FROM_MASTER_HELPER_LOCK, MPI_COMM_WORLD, &status);  // квант заблокирован
+    MPI_Recv(&ans, 1, MPI_INT, home, GET_LOCK_FROM_MASTER_HELPER + slot, MPI_COMM_WORLD, MPI_STATUS_IGNORE);  // квант заблокирован
+    std::lock_guard<std::recursive_mutex> lock(compute_mutex);
+    lock_waiters[slot] = false;
 }
 
 void memory_manager::unset_lock(int key, int quantum_index) {
-    int request[3] = {UNLOCK, key, quantum_index};
-    MPI_Send(request, 3, MPI_INT, 0, SEND_DATA_TO_MASTER_HELPER, MPI_COMM_WORLD);  // отправление мастеру запроса о разблокировке кванта
+    {
+        std::lock_guard<std::recursive_mutex> lock(compute_mutex);
+        wait_accumulates();
+        post_request(get_home(key, quantum_index), {UNLOCK, key, quantum_index, -1, -1});  // отправление каталогу запроса о разблокировке кванта
+        flush_requests();
+    }
+    memory[key]->quantums[quantum_index].local_lock->unlock();
 }
 
-void memory_manager::change_mode(int key, int quantum_index_l, int quantum_index_r, mods mode) {  // block quantums [l, r)
-    // информирование мастера о том, что данный процесс дошёл до этапа изменения режима работы с памятью
-    int request[4] = {CHANGE_MODE, key, quantum_index_l, quantum_index_r};
-    MPI_Send(request, 4, MPI_INT, 0, SEND_DATA_TO_MASTER_HELPER, MPI_COMM_WORLD);
-    int is_ready;
-    MPI_Status status;
-    MPI_Recv(&is_ready, 1, MPI_INT, 0, GET_PERMISSION_FOR_CHANGE_MODE, MPI_COMM_WORLD, &status);  // после получения ответа данный процесс может продолжить выполнение
-    auto* memory = dynamic_cast<memory_line_worker*>(memory_manager::memory[key]);
+void memory_manager::change_mode(int key, int quantum_index_l, int quantum_index_r, mods mode, bool is_replica) {  // block quantums [l, r)
+    change_mode_begin(key, quantum_index_l, quantum_index_r, mode, is_replica);
+    change_mode_end();
+}
+
+void memory_manager::change_mode_begin(int key, int quantum_index_l, int quantum_index_r, mods mode, bool is_replica) {
+    std::lock_guard<std::recursive_mutex> lock(compute_mutex);
+    CHECK(current_mode_change.key == -1, STATUS_ERR_UNKNOWN);  // предыдущая смена режима не завершена
+    wait_all_pending();
+    auto* memory = memory_manager::memory[key];
+    // изменения WRITE_SHARED копий выполняются владельцами до того, как каталог сменит режим
+    for (int i = quantum_index_l; i < quantum_index_r; ++i) {
+        if (memory->quantums[i].twin != nullptr) {
+            release_shared(key, i);
+        }
+    }
+    wait_accumulates();  // каталог меняет режим, когда все процессы дошли до смены режима, к этому времени все операции выполнены
+    // информирование частей каталога, хранящих кванты [l, r), о том, что данный процесс дошёл до этапа изменения режима работы с памятью;
+    // при пустом диапазоне запись отправляется части каталога, хранящей квант l
+    int num_of_quantums = int(memory->quantums.size());
+    int home_l = get_home(key, std::min(quantum_index_l, num_of_quantums - 1));
+    int home_r = (quantum_index_r > quantum_index_l) ? get_home(key, std::min(quantum_index_r, num_of_quantums) - 1) : home_l;
+    // при числе квантов меньше числа процессов часть каталога может быть пустой, такие процессы пропускаются
+    for (int home = home_l; home <= home_r; ++home) {
+        if (get_first_quantum(num_of_quantums, home) < get_first_quantum(num_of_quantums, home + 1))
+            post_request(home, {CHANGE_MODE, key, quantum_index_l, quantum_index_r, 2 * mode + ((is_replica && mode == READ_ONLY) ? 1 : 0)});
+    }
+    flush_requests();  // следующие посылки данного процесса по структуре каталог обработает после смены режима
+    auto& change = current_mode_change;
+    change.key = key;
+    change.quantum_index_l = quantum_index_l;
+    change.quantum_index_r = quantum_index_r;
+    change.mode = mode;
+    // барьер рабочих совмещён с обменом сведениями для рассылки копий: запрошены ли копии и сколько квантов процесс примет без вытеснения
+    change.info[0] = (is_replica && mode == READ_ONLY) ? 1 : 0;
+    change.info[1] = memory->cache.get_cache_size() - memory->cache.get_num_pinned();
+    change.infos.assign(2 * worker_size, 0);
+    MPI_Iallgather(change.info, 2, MPI_INT, change.infos.data(), 2, MPI_INT, workers_comm, &change.request);
+}
+
+void memory_manager::change_mode_end() {
+    std::lock_guard<std::recursive_mutex> lock(compute_mutex);
+    auto& change = current_mode_change;
+    CHECK(change.key != -1, STATUS_ERR_UNKNOWN);  // смена режима не начата
+    MPI_Wait(&change.request, MPI_STATUS_IGNORE);  // все процессы дошли до смены режима, их обращения в прежнем режиме завершены
+    int key = change.key, quantum_index_l = change.quantum_index_l, quantum_index_r = change.quantum_index_r;
+    change.key = -1;
+    auto* memory = memory_manager::memory[key];
     for (int i = quantum_index_l; i < quantum_index_r; ++i) {
 
         // работа с кешем
         memory->quantums[i].mutex->lock();
-        if (mode == READ_ONLY) {
+        CHECK(memory->quantums[i].pins == 0, STATUS_ERR_UNKNOWN);  // смена режима закреплённого кванта запрещена
+        if (change.mode == READ_ONLY) {
             if (memory->quantums[i].quantum != nullptr) {
                 memory->cache.add_to_excluded(i);
             }
-        } else {  // READ_WRITE
+        } else {  // READ_WRITE или WRITE_SHARED
             if (memory->quantums[i].quantum != nullptr &&
                     (memory->cache.is_contain(i) || memory->cache.is_excluded(i))) {
                 memory->cache.delete_elem(i);
             }
         }
-        memory->quantums[i].mutex->unlock();
         memory->quantums[i].is_mode_changed = true;
-        memory->quantums[i].mode = mode;
+        memory->quantums[i].mode = change.mode;
+        memory->quantums[i].owner_hint = -1;  // копии прошлого режима устарели
+        memory->quantums[i].mutex->unlock();
+    }
+    bool is_replicate = false;
+    for (int i = 0; i < worker_size; ++i) {
+        is_replicate = is_replicate || change.infos[2 * i] == 1;
+    }
+    if (!is_replicate || quantum_index_l >= quantum_index_r)
+        return;
+    // копии запрошены: каждая часть каталога после смены режима сообщает владельцев своих квантов из [l, r)
+    int num_of_quantums = int(memory->quantums.size());
+    std::vector<int> owners(quantum_index_r - quantum_index_l);
+    for (int home = get_home(key, quantum_index_l); home <= get_home(key, quantum_index_r - 1); ++home) {
+        int first = std::max(quantum_index_l, get_first_quantum(num_of_quantums, home));
+        int last = std::min(quantum_index_r, get_first_quantum(num_of_quantums, home + 1));
+        if (first < last) {
+            MPI_Recv(owners.data() + first - quantum_index_l, last - first, MPI_INT, home, GET_PERMISSION_FOR_CHANGE_MODE, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+        }
+    }
+    replicate(key, quantum_index_l, owners, change.infos);
+}
+
+void memory_manager::replicate(int key, int quantum_index_l, const std::vector<int>& owners, const std::vector<int>& infos) {
+    auto* memory = memory_manager::memory[key];
+    // процессы, получающие копии, и число квантов, которое они примут без вытеснения друг друга
+    std::vector<int> replicas;
+    int budget = int(owners.size());
+    for (int i = 0; i < worker_size; ++i) {
+        if (infos[2 * i] == 1) {
+            replicas.push_back(i + 1);
+            budget = std::min(budget, infos[2 * i + 1]);
+        }
+    }
+    std::vector<int> quantums;  // рассылаются первые budget инициализированных квантов диапазона
+    for (int i = 0; i < (int)owners.size() && (int)quantums.size() < budget; ++i) {
+        if (owners[i] != -1)
+            quantums.push_back(quantum_index_l + i);
+    }
+    // квант рассылается по биномиальному дереву: корень - владелец, затем получатели по возрастанию номера,
+    // родитель узла pos - pos без старшего бита, дети - pos + m для степеней двойки m > pos.
+    // Все кванты группы рассылаются одновременно, каждый узел пересылает квант детям сразу по получении
+    for (int first = 0; first < (int)quantums.size(); first += MAX_QUANTUMS_IN_REQUEST) {
+        int count = std::min((int)quantums.size() - first, MAX_QUANTUMS_IN_REQUEST);
+        std::vector<std::vector<int>> trees(count);
+        std::vector<int> positions(count, -1);
+        std::vector<MPI_Request> recvs(count, MPI_REQUEST_NULL), sends;
+        auto send_to_children = [&](int i) {
+            auto& tree = trees[i];
+            int pos = positions[i], m = 1;
+            while (pos + m * 2 < (int)tree.size())
+                m *= 2;
+            for (; m > pos && pos + m < (int)tree.size(); m /= 2) {  // сначала в большее поддерево
+                sends.emplace_back();
+                MPI_Isend(memory->quantums[quantums[first + i]].quantum, memory->quantum_size, memory->type, tree[pos + m],
+                          REPLICATE_DATA + i, MPI_COMM_WORLD, &sends.back());
+            }
+        };
+        for (int i = 0; i < count; ++i) {
+            int quantum_index = quantums[first + i], root = owners[quantum_index - quantum_index_l];
+            auto& tree = trees[i];
+            tree.push_back(root);
+            for (auto process: replicas) {
+                if (process != root)
+                    tree.push_back(process);
+            }
+            positions[i] = int(std::find(tree.begin(), tree.end(), rank) - tree.begin());
+            if (positions[i] == (int)tree.size()) {
+                positions[i] = -1;
+            } else if (positions[i] == 0) {
+                CHECK(memory->quantums[quantum_index].quantum != nullptr, STATUS_ERR_NULLPTR);
+                send_to_children(i);
+            } else {
+#ifdef ENABLE_STATISTICS_COLLECTION
+    #if (ENABLE_STATISTICS_QUANTUMS_CNT_WORKERS)
+                collect_statistic_worker(key, quantum_index);
+                memory->quantums[quantum_index].cnt.push_back(0);
+                memory->quantums[quantum_index].modes.push_back(READ_ONLY);
+    #endif
+#endif
+                // уведомления о вытеснении уходят после завершения рассылки, поэтому память пересылаемых квантов не освобождается раньше времени.
+                // По бюджету кеша вытесняются только кванты других структур: принимаемые кванты не должны вытесняться
+                int removing_quantum_index = cache_add(key, quantum_index, false);
+                if (removing_quantum_index >= 0) {
+                    post_request(get_home(key, removing_quantum_index), {EVICT, key, removing_quantum_index, -1, -1});
+                }
+                reserve_quantum(key, quantum_index);
+                int pos = positions[i], parent = pos;
+                while (parent & (parent - 1))
+                    parent &= parent - 1;
+                MPI_Irecv(memory->quantums[quantum_index].quantum, memory->quantum_size, memory->type, tree[pos - parent],
+                          REPLICATE_DATA + i, MPI_COMM_WORLD, &recvs[i]);
+            }
+        }
+        int index = MPI_UNDEFINED;
+        MPI_Waitany(count, recvs.data(), &index, MPI_STATUS_IGNORE);
+        while (index != MPI_UNDEFINED) {
+            int quantum_index = quantums[first + index];
+            send_to_children(index);
+            reset_mode_changed(key, quantum_index);
+            set_received(key, quantum_index);
+            memory->quantums[quantum_index].owner_hint = trees[index][0];
+            send_set_info(key, quantum_index, -1);
+            MPI_Waitany(count, recvs.data(), &index, MPI_STATUS_IGNORE);
+        }
+        MPI_Waitall(int(sends.size()), sends.data(), MPI_STATUSES_IGNORE);
+    }
+    flush_requests();
+}
+
+void memory_manager::send_get_info(int key, int quantum_index, int removing_quantum_index, int reply_tag, int data_tag) {
+    if (removing_quantum_index >= 0) {  // уведомление о вытеснении кванта из кеша отправляется части каталога, хранящей этот квант
+        post_request(get_home(key, removing_quantum_index), {EVICT, key, removing_quantum_index, -1, -1});
+    }
+    post_request(get_home(key, quantum_index), {GET_INFO, key, quantum_index, reply_tag, data_tag});
+}
+
+int memory_manager::get_info(int key, int quantum_index, int removing_quantum_index) {
+    // квант может прийти только после того, как его получит прежний владелец, поэтому асинхронные запросы завершаются заранее:
+    // иначе другой процесс может ждать квант, который данный процесс получает асинхронно
+    wait_all_pending();
+    auto* memory = memory_manager::memory[key];
+    void* data = memory->quantums[quantum_index].quantum;
+    int home = get_home(key, quantum_index);
+    int reply[REPLY_SIZE] = {-2, -1};
+    MPI_Status status;
+    if (memory->quantums[quantum_index].mode == READ_WRITE) {
+        // квант приходит от владельца вместе с правом владения, каталог отвечает, только если пересылки не будет
+        CHECK(removing_quantum_index == -1, STATUS_ERR_UNKNOWN);
+        MPI_Request requests[2];
+        MPI_Irecv(data, memory->quantum_size, memory->type, MPI_ANY_SOURCE, GET_GRANT_FROM_HELPER, MPI_COMM_WORLD, &requests[0]);
+        MPI_Irecv(reply, REPLY_SIZE, MPI_INT, home, GET_INFO_FROM_MASTER_HELPER, MPI_COMM_WORLD, &requests[1]);
+        post_request(home, {GET_GRANT, key, quantum_index, GET_INFO_FROM_MASTER_HELPER, GET_GRANT_FROM_HELPER});
+        flush_requests();
+        int index = MPI_UNDEFINED;
+        MPI_Waitany(2, requests, &index, &status);
+        int to_rank = (index == 0) ? status.MPI_SOURCE : reply[0];
+        MPI_Cancel(&requests[1 - index]);  // приходит либо квант, либо ответ каталога
+        MPI_Wait(&requests[1 - index], MPI_STATUS_IGNORE);
+        CHECK(index == 0 || to_rank == rank, STATUS_ERR_WRONG_RANK);
+        return to_rank;
+    }
+    if (removing_quantum_index >= 0) {  // уведомление о вытеснении уходит и при получении кванта в обход каталога
+        post_request(get_home(key, removing_quantum_index), {EVICT, key, removing_quantum_index, -1, -1});
+    }
+    if (get_hinted_data(key, quantum_index)) {
+        flush_requests();
+        return rank;  // каталог о копии не знает, уведомлять его не нужно
+    }
+    send_get_info(key, quantum_index, -1, GET_INFO_FROM_MASTER_HELPER, GET_DATA_FROM_HELPER);
+    flush_requests();
+    MPI_Recv(reply, REPLY_SIZE, MPI_INT, home, GET_INFO_FROM_MASTER_HELPER, MPI_COMM_WORLD, &status);  // получение ответа от каталога
+    int to_rank = reply[0], slot = reply[1];
+    if (to_rank != rank) {  // если данные не у текущего процесса, инициируется передача данных от указанного каталогом процесса
+        CHECK(to_rank > 0 && to_rank < size, STATUS_ERR_WRONG_RANK);
+        if (memory->quantums[quantum_index].mode == READ_ONLY) {
+            memory->quantums[quantum_index].owner_hint = to_rank;
+        }
+        if (slot != -1) {  // квант читается из памяти владельца без участия его вспомогательного потока
+            read_quantum(key, quantum_index, to_rank, slot);
+            wait_reads(key);
+        } else {
+            MPI_Recv(data, memory->quantum_size, memory->type, to_rank, GET_DATA_FROM_HELPER, MPI_COMM_WORLD, &status);
+        }
+    }
+    return to_rank;
+}
+
+bool memory_manager::get_hinted_data(int key, int quantum_index) {
+#if (ENABLE_OWNER_HINTS)
+    auto* memory = memory_manager::memory[key];
+    auto& quantum = memory->quantums[quantum_index];
+    if (quantum.owner_hint == -1)
+        return false;
+    int request[REQUEST_SIZE] = {GET_DATA_HINT, key, quantum_index, rank, GET_HINTED_DATA_FROM_HELPER};
+    MPI_Send(request, REQUEST_SIZE, MPI_INT, quantum.owner_hint, SEND_DATA_TO_HELPER, MPI_COMM_WORLD);
+    MPI_Status status;
+    int count = 0;
+    MPI_Recv(quantum.quantum, memory->quantum_size, memory->type, quantum.owner_hint, GET_HINTED_DATA_FROM_HELPER, MPI_COMM_WORLD, &status);
+    MPI_Get_count(&status, memory->type, &count);
+    if (count == memory->quantum_size)
+        return true;
+    quantum.owner_hint = -1;  // копии больше нет, квант запрашивается у каталога
+#endif
+    return false;
+}
+
+int memory_manager::get_slot(int key, int quantum_index) {
+#if (ENABLE_RMA_READ_ONLY)
+    auto* memory = memory_manager::memory[key];
+    if (memory->win == MPI_WIN_NULL)
+        return -1;
+    CHECK(memory->quantums[quantum_index].quantum != nullptr, STATUS_ERR_NULLPTR);
+    return memory->allocator.get_slot(reinterpret_cast<const char*>(memory->quantums[quantum_index].quantum));
+#else
+    (void)key;
+    (void)quantum_index;
+    return -1;
+#endif
+}
+
+void memory_manager::read_quantum(int key, int quantum_index, int from_rank, int slot) {
+#if (ENABLE_RMA_READ_ONLY)
+    auto* memory = memory_manager::memory[key];
+    CHECK(memory->quantums[quantum_index].quantum != nullptr, STATUS_ERR_NULLPTR);
+    int target = from_rank - 1;  // номер процесса в workers_comm
+    int slab = memory_allocator::get_slab(slot);
+    auto& slabs = memory->remote_slabs[target];
+    if (slabs.empty() || slabs[slab] == 0) {  // таблица блоков ещё не прочитана или прочитана до выделения нужного блока
+        slabs.resize(MAX_SLABS);
+        MPI_Get(slabs.data(), MAX_SLABS, MPI_AINT, target, memory->slab_tables[target], MAX_SLABS, MPI_AINT, memory->win);
+        MPI_Win_flush(target, memory->win);
+        CHECK(slabs[slab] != 0, STATUS_ERR_NULLPTR);
+    }
+    MPI_Get(memory->quantums[quantum_index].quantum, memory->quantum_size, memory->type, target,
+            slabs[slab] + memory->allocator.get_offset(slot), memory->quantum_size, memory->type, memory->win);
+#else
+    (void)key;
+    (void)quantum_index;
+    (void)from_rank;
+    (void)slot;
+    ABORT(STATUS_ERR_UNKNOWN);
+#endif
+}
+
+void memory_manager::wait_reads(int key) {
+#if (ENABLE_RMA_READ_ONLY)
+    auto* memory = memory_manager::memory[key];
+    if (memory->win != MPI_WIN_NULL)
+        MPI_Win_flush_all(memory->win);
+#else
+    (void)key;
+#endif
+}
+
+int memory_manager::cache_add(int key, int quantum_index, bool can_evict_own) {
+    auto* memory = memory_manager::memory[key];
+    int removing_quantum_index = -1;
+    if (cache_budget > 0 && !memory->cache.is_contain(quantum_index) && !memory->cache.is_excluded(quantum_index)) {
+        removing_quantum_index = fit_cache_budget(key, can_evict_own);
+    }
+    // после вытеснения по бюджету в кеше структуры есть место; без вытеснения своих квантов добавляются кванты одной посылки
+    int evicted_quantum_index = memory->cache.add(quantum_index, can_evict_own);
+    if (evicted_quantum_index >= 0) {
+        removing_quantum_index = evicted_quantum_index;
+    }
+    if (removing_quantum_index >= 0) {
+        mark_removing(key, removing_quantum_index);
+    }
+    return removing_quantum_index;
+}
+
+int memory_manager::fit_cache_budget(int key, bool can_evict_own) {
+    auto* memory = memory_manager::memory[key];
+    if (memory->cache.get_num_cached() == memory->cache.get_cache_size())
+        return -1;  // квант вытеснит квант той же структуры при добавлении в её кеш
+    long long now = memory_cache::get_ticks();
+    long long cached_bytes = get_cached_bytes();
+    while (cached_bytes + (long long)memory->quantum_size * memory->size_of > cache_budget) {
+        // вытесняется квант структуры, первый кандидат на вытеснение которой дольше всего не использовался;
+        // время без обращений умножается на размер кванта, чтобы крупные кванты освобождали место раньше
+        int victim_key = -1;
+        double victim_score = -1;
+        for (int k = 0; k < (int)memory_manager::memory.size(); ++k) {
+            auto* line = memory_manager::memory[k];
+            if (line == nullptr || (k == key && !can_evict_own))
+                continue;
+            long long tick = line->cache.get_coldest_tick();
+            if (tick == -1)
+                continue;
+            double score = double(now - tick + 1) * line->quantum_size * line->size_of;
+            if (score > victim_score) {
+                victim_key = k;
+                victim_score = score;
+            }
+        }
+        if (victim_key == -1)
+            return -1;  // остальные кванты закреплены, бюджет превышается на их размер
+        auto* line = memory_manager::memory[victim_key];
+        int victim = line->cache.evict_one();
+        if (victim_key == key)
+            return victim;  // уведомление о вытеснении отправляет вызывающая функция
+        mark_removing(victim_key, victim);
+        post_request(get_home(victim_key, victim), {EVICT, victim_key, victim, -1, -1});
+        cached_bytes -= (long long)line->quantum_size * line->size_of;
+    }
+    return -1;
+}
+
+void memory_manager::mark_removing(int key, int quantum_index) {
+    auto& removing_quantum = memory_manager::memory[key]->quantums[quantum_index];
+    if (removing_quantum.pending != -1) {  // каталог должен узнать о вытесняемом кванте после SET_INFO
+        complete_pending(removing_quantum.pending);
+    }
+    removing_quantum.mutex->lock();
+    removing_quantum.is_removing = true;
+    removing_quantum.mutex->unlock();
+}
+
+long long memory_manager::get_cached_bytes() {
+    long long bytes = 0;
+    for (auto* line: memory_manager::memory) {
+        if (line != nullptr)
+            bytes += (long long)line->cache.get_num_cached() * line->quantum_size * line->size_of;
+    }
+    return bytes;
+}
+
+void memory_manager::set_cache_budget(long long bytes) {
+    CHECK(bytes >= 0, STATUS_ERR_OUT_OF_BOUNDS);
+    cache_budget = bytes;
+}
+
+void memory_manager::reserve_quantum(int key, int quantum_index) {
+    auto& quantum = memory_manager::memory[key]->quantums[quantum_index];
+    reclaim_retired(key);
+    quantum.mutex->lock();
+    quantum.version->fetch_or(2);  // до приёма данных другие потоки не обращаются к кванту без мьютекса
+    // DELETE по ранее вытесненному кванту может прийти позже нового запроса и не должен освобождать память, в которую принимается квант
+    quantum.is_removing = false;
+    quantum.is_delete_deferred = false;
+    if (quantum.quantum == nullptr) {
+        quantum.quantum = memory_manager::memory[key]->allocator.alloc();
+    }
+    quantum.mutex->unlock();
+}
+
+void memory_manager::reset_mode_changed(int key, int quantum_index) {
+    auto& quantum = memory_manager::memory[key]->quantums[quantum_index];
+    // после смены режима вспомогательный поток может ещё пересылать устаревшую копию кванта и освободит память,
+    // если увидит сброшенный флаг, поэтому флаг сбрасывается под мьютексом
+    quantum.mutex->lock();
+    quantum.is_mode_changed = false;
+    quantum.mutex->unlock();
+}
+
+void memory_manager::set_received(int key, int quantum_index) {
+    auto& quantum = memory_manager::memory[key]->quantums[quantum_index];
+    quantum.mutex->lock();
+#if (LEASE_TIME_US > 0)
+    if (quantum.mode == READ_WRITE) {
+        quantum.lease_start = MPI_Wtime();
+        quantum.lease_accesses->store(0, std::memory_order_relaxed);
+    }
+#endif
+    quantum.version->fetch_and(~2u, std::memory_order_release);
+    if (!quantum.deferred_accumulates.empty()) {  // операции, пришедшие владельцу до приёма кванта, выполняются до его передачи дальше
+        std::vector<int> acks(size, 0);
+        for (int pos = 0; pos < (int)quantum.deferred_accumulates.size(); pos += (1 + get_payload_records(quantum.deferred_accumulates.data() + pos)) * REQUEST_SIZE) {
+            apply_accumulate(key, quantum.deferred_accumulates.data() + pos, acks);
+        }
+        quantum.deferred_accumulates.clear();
+        send_accumulate_acks(acks);
+    }
+    int request[REQUEST_SIZE] = {GET_DATA_RW, key, quantum_index, quantum.deferred_to_rank, quantum.deferred_tag};
+    bool is_deferred = quantum.deferred_to_rank != -1 && quantum.pins == 0;
+    if (is_deferred) {
+        quantum.deferred_to_rank = quantum.deferred_tag = -1;
+    }
+    quantum.mutex->unlock();
+    if (is_deferred) {  // право владения передано дальше до приёма кванта, пересылку выполняет вспомогательный поток
+        MPI_Send(request, REQUEST_SIZE, MPI_INT, rank, SEND_DATA_TO_HELPER, MPI_COMM_WORLD);
     }
 }
 
+int memory_manager::start_get_info(int key, int quantum_index) {
+    auto* memory = memory_manager::memory[key];
+    auto& quantum = memory->quantums[quantum_index];
+    int slot = next_pending;
+    next_pending = (next_pending + 1) % MAX_PENDING_REQUESTS;
+    if (pending[slot].key != -1) {  // все слоты заняты, самый старый запрос завершается
+        complete_pending(slot);
+    }
+#ifdef ENABLE_STATISTICS_COLLECTION
+    #if (ENABLE_STATISTICS_QUANTUMS_CNT_WORKERS)
+    collect_statistic_worker(key, quantum_index);
+    quantum.cnt.push_back(0);  // обращение учитывается при чтении или записи элемента
+    quantum.modes.push_back(quantum.mode);
+    #endif
+#endif
+    // работа с кешем
+    if (quantum.is_mode_changed && quantum.mode != READ_ONLY) {
+        if (memory->cache.is_contain(quantum_index)) {
+            memory->cache.delete_elem(quantum_index);
+        }
+    }
+    int removing_quantum_index = -1;
+    if (quantum.mode == READ_ONLY) {
+        removing_quantum_index = cache_add(key, quantum_index);
+    }
+    reserve_quantum(key, quantum_index);
+    auto& request = pending[slot];
+    request.key = key;
+    request.quantum_index = quantum_index;
+    // отправитель кванта станет известен только из ответа каталога, поэтому приём данных ожидается от любого процесса с тегом слота
+    MPI_Irecv(quantum.quantum, memory->quantum_size, memory->type, MPI_ANY_SOURCE, GET_ASYNC_DATA_FROM_HELPER + slot, MPI_COMM_WORLD, &pending_info[MAX_PENDING_REQUESTS + slot]);
+    MPI_Irecv(request.reply, REPLY_SIZE, MPI_INT, get_home(key, quantum_index), GET_ASYNC_INFO_FROM_MASTER_HELPER + slot, MPI_COMM_WORLD, &pending_info[slot]);
+    send_get_info(key, quantum_index, removing_quantum_index, GET_ASYNC_INFO_FROM_MASTER_HELPER + slot, GET_ASYNC_DATA_FROM_HELPER + slot);
+    quantum.pending = slot;
+    ++pending_count;
+    return slot;
+}
+
+void memory_manager::finish_pending(int slot) {
+    auto& request = pending[slot];
+    auto* memory = memory_manager::memory[request.key];
+    auto& quantum = memory->quantums[request.quantum_index];
+    int to_rank = request.reply[0], remote_slot = request.reply[1];
+    if (to_rank != rank) {
+        CHECK(to_rank > 0 && to_rank < size, STATUS_ERR_WRONG_RANK);
+        if (quantum.mode == READ_ONLY) {
+            quantum.owner_hint = to_rank;
+        }
+    }
+    if (remote_slot != -1) {
+        read_quantum(request.key, request.quantum_index, to_rank, remote_slot);
+        wait_reads(request.key);
+    }
+    reset_mode_changed(request.key, request.quantum_index);
+    make_twin(request.key, request.quantum_index, to_rank);  // до отложенных записей
+    quantum.pending = -1;
+    if (!request.writes.empty()) {
+        quantum.mutex->lock();
+        for (auto& write: request.writes) {
+            std::memcpy(reinterpret_cast<char*>(quantum.quantum) + write.first, write.second.data(), write.second.size());
+        }
+        quantum.mutex->unlock();
+        request.writes.clear();
+    }
+    set_received(request.key, request.quantum_index);
+    if (quantum.mode != READ_ONLY || to_rank != rank) {  // уведомление каталога о том, что данные готовы для передачи другим процессам
+        send_set_info(request.key, request.quantum_index, (to_rank != rank) ? to_rank : -1);
+    }
+    request.key = -1;
+    request.quantum_index = -1;
+    --pending_count;
+}
+
+void memory_manager::complete_pending(int slot) {
+    // запросы завершаются в порядке поступления квантов: ожидание только по slot может привести к взаимной блокировке,
+    // если квант slot пересылает процесс, который сам ждёт квант, уже полученный данным процессом по другому запросу
+    while (pending[slot].key != -1) {
+        finish_ready_pending();
+    }
+    flush_requests();
+}
+
+void memory_manager::wait_pending(int key, int quantum_index) {
+    std::lock_guard<std::recursive_mutex> lock(compute_mutex);
+    int slot = memory_manager::memory[key]->quantums[quantum_index].pending;
+    if (slot != -1) {
+        complete_pending(slot);
+    }
+}
+
+void memory_manager::wait_all_pending() {
+    std::lock_guard<std::recursive_mutex> lock(compute_mutex);
+    while (pending_count > 0) {
+        finish_ready_pending();
+    }
+    flush_requests();
+}
+
+void memory_manager::prefetch(int key, int quantum_index_l, int quantum_index_r, bool is_claim) {
+    CHECK(key >= 0 && key < (int)memory_manager::memory.size(), STATUS_ERR_OUT_OF_BOUNDS);
+    auto* memory = memory_manager::memory[key];
+    CHECK(quantum_index_l >= 0 && quantum_index_l <= quantum_index_r && quantum_index_r <= (int)memory->quantums.size(), STATUS_ERR_OUT_OF_BOUNDS);
+    std::lock_guard<std::recursive_mutex> lock(compute_mutex);
+    // READ_ONLY кванты запрашиваются не больше размера кеша, иначе последние запрошенные вытесняли бы первые
+    int read_only_cnt = 0;
+    for (int i = quantum_index_l; i < quantum_index_r; ++i) {
+        auto& quantum = memory->quantums[i];
+        if (quantum.pending != -1)
+            continue;
+        if (quantum.mode == READ_ONLY) {
+            if (read_only_cnt == memory->cache.get_cache_size())
+                continue;
+            ++read_only_cnt;
+        } else if (quantum.mode == READ_WRITE && !is_claim) {  // копия WRITE_SHARED кванта не забирает его у других процессов
+            continue;
+        }
+        quantum.mutex->lock();
+        bool is_present = !quantum.is_mode_changed && quantum.quantum != nullptr;
+        quantum.mutex->unlock();
+        if (!is_present) {
+            start_get_info(key, i);  // запросы всех квантов уходят одной посылкой каждой части каталога
+        }
+    }
+    flush_requests();
+}
+
+bool memory_manager::pin_quantum(int key, int quantum_index) {
+    std::lock_guard<std::recursive_mutex> lock(compute_mutex);
+    auto* memory = memory_manager::memory[key];
+    auto& quantum = memory->quantums[quantum_index];
+    quantum.mutex->lock();
+    bool is_present = !quantum.is_mode_changed && quantum.quantum != nullptr;
+    if (is_present && quantum.pins++ == 0 && memory->cache.is_contain(quantum_index)) {
+        memory->cache.pin(quantum_index);
+    }
+    quantum.mutex->unlock();
+    return is_present;
+}
+
+void memory_manager::release_view(int key, int quantum_index) {
+    std::lock_guard<std::recursive_mutex> lock(compute_mutex);
+    auto* memory = memory_manager::memory[key];
+    auto& quantum = memory->quantums[quantum_index];
+    quantum.mutex->lock();
+    CHECK(quantum.pins > 0, STATUS_ERR_UNKNOWN);
+    if (--quantum.pins == 0) {
+        if (memory->cache.is_pinned(quantum_index)) {  // квант мог быть закреплён уже после вытеснения из кеша
+            memory->cache.unpin(quantum_index);
+        }
+        if (quantum.is_delete_deferred) {
+            quantum.is_delete_deferred = false;
+            if (quantum.is_removing) {
+                free_removed(key, quantum_index);
+            }
+        }
+        if (quantum.deferred_to_rank != -1) {
+            send_quantum(key, quantum_index, quantum.deferred_to_rank, quantum.deferred_tag);
+            quantum.deferred_to_rank = quantum.deferred_tag = -1;
+        }
+    }
+    quantum.mutex->unlock();
+}
+
+bool memory_manager::is_leased(quantum_worker& quantum) {
+#if (LEASE_TIME_US > 0)
+    if ((MPI_Wtime() - quantum.lease_start) * 1e6 >= LEASE_TIME_US)
+        return false;
+  #if (LEASE_ACCESSES > 0)
+    return quantum.lease_accesses->load(std::memory_order_relaxed) < LEASE_ACCESSES;
+  #else
+    return true;
+  #endif
+#else
+    (void)quantum;
+    return false;
+#endif
+}
+
+void memory_manager::serve_leases(std::vector<std::pair<int, int>>& leased) {
+    for (int i = 0; i < (int)leased.size(); ) {
+        auto& quantum = memory[leased[i].first]->quantums[leased[i].second];
+        quantum.mutex->lock();
+        // запрос уже выполнен при откреплении, либо квант закреплён и будет отправлен при откреплении
+        bool is_done = quantum.deferred_to_rank == -1 || quantum.pins > 0;
+        if (!is_done && !is_leased(quantum)) {
+            send_quantum(leased[i].first, leased[i].second, quantum.deferred_to_rank, quantum.deferred_tag);
+            quantum.deferred_to_rank = quantum.deferred_tag = -1;
+            is_done = true;
+        }
+        quantum.mutex->unlock();
+        if (is_done) {
+            leased[i] = leased.back();
+            leased.pop_back();
+        } else {
+            ++i;
+        }
+    }
+}
+
+void memory_manager::send_quantum(int key, int quantum_index, int to_rank, int tag) {
+    auto* memory = memory_manager::memory[key];
+    auto& quantum = memory->quantums[quantum_index];
+    // запись потока вычислений без мьютекса либо попадает в отправляемые данные, либо видит изменённую версию и повторяется
+    quantum.version->fetch_add(1);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    MPI_Send(quantum.quantum, memory->quantum_size, memory->type, to_rank, tag, MPI_COMM_WORLD);
+    // после отправки данных в READ_WRITE режиме квант на данном процессе удаляется;
+    // после смены режима отправляется копия, в которую данный процесс может уже принимать квант, поэтому память сохраняется
+    if (!quantum.is_mode_changed) {
+        retire(key, quantum_index);
+    }
+    quantum.version->fetch_add(3, std::memory_order_release);  // бит 0 сбрасывается, версия увеличивается на 4
+}
+
+void memory_manager::free_removed(int key, int quantum_index) {
+    auto* memory = memory_manager::memory[key];
+    auto& quantum = memory->quantums[quantum_index];
+    quantum.is_removing = false;
+    quantum.version->fetch_add(1);  // вытесняются только READ_ONLY кванты: в них не записывают, чтение без мьютекса проверяется по версии
+    memory->allocator.free(reinterpret_cast<char**>(&(quantum.quantum)));
+    quantum.version->fetch_add(3, std::memory_order_release);  // бит 0 сбрасывается, версия увеличивается на 4
+}
+
+void memory_manager::register_thread() {
+    for (auto& epoch: thread_epochs) {
+        unsigned long long expected = 0;
+        if (epoch.compare_exchange_strong(expected, global_epoch.load())) {
+            thread_epoch = thread_epoch_slot.epoch = &epoch;
+            // парный барьер - в reclaim_retired: либо слот виден освобождающему потоку, либо поток видит версию переданного кванта
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            return;
+        }
+    }
+    ABORT(STATUS_ERR_OUT_OF_BOUNDS);
+}
+
+void memory_manager::retire(int key, int quantum_index) {
+    auto* memory = memory_manager::memory[key];
+    auto& quantum = memory->quantums[quantum_index];
+    {
+        std::lock_guard<std::mutex> lock(memory->retired_mutex);
+        memory->retired.emplace_back(static_cast<char*>(quantum.quantum), global_epoch.fetch_add(1));
+    }
+    quantum.quantum = nullptr;
+    reclaim_retired(key);
+}
+
+void memory_manager::reclaim_retired(int key) {
+    auto* memory = memory_manager::memory[key];
+    std::lock_guard<std::mutex> lock(memory->retired_mutex);
+    if (memory->retired.empty())
+        return;
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    unsigned long long min_epoch = global_epoch.load();
+    for (auto& epoch: thread_epochs) {
+        unsigned long long value = epoch.load(std::memory_order_acquire);
+        if (value != 0 && value < min_epoch)
+            min_epoch = value;
+    }
+    // память, переданная в эпоху e, больше не записывается, если все потоки записали в слоты эпоху больше e
+    for (size_t i = 0; i < memory->retired.size(); ) {
+        if (memory->retired[i].second < min_epoch) {
+            memory->allocator.free(&memory->retired[i].first);
+            memory->retired[i] = memory->retired.back();
+            memory->retired.pop_back();
+        } else {
+            ++i;
+        }
+    }
+}
+
+void memory_manager::make_twin(int key, int quantum_index, int from_rank) {
+    auto* memory = memory_manager::memory[key];
+    auto& quantum = memory->quantums[quantum_index];
+    if (quantum.mode != WRITE_SHARED || from_rank == rank)  // копия владельца изменяется на месте
+        return;
+    quantum.mutex->lock();
+    if (quantum.twin == nullptr) {
+        quantum.twin = memory->allocator.alloc();
+    }
+    std::memcpy(quantum.twin, quantum.quantum, size_t(memory->quantum_size) * memory->size_of);
+    quantum.mutex->unlock();
+}
+
+void memory_manager::release_shared(int key, int quantum_index) {
+    auto* memory = memory_manager::memory[key];
+    auto& quantum = memory->quantums[quantum_index];
+    int size_of = memory->size_of;
+    CHECK(quantum.pins == 0, STATUS_ERR_UNKNOWN);  // смена режима закреплённого кванта запрещена
+    CHECK(quantum.quantum != nullptr, STATUS_ERR_NULLPTR);
+    const char* data = reinterpret_cast<const char*>(quantum.quantum);
+    const char* twin = reinterpret_cast<const char*>(quantum.twin);
+    auto is_changed = [&](int i) { return std::memcmp(data + size_t(i) * size_of, twin + size_t(i) * size_of, size_of) != 0; };
+    auto& requests = to_directory[get_home(key, quantum_index) * NUMBER_OF_MASTER_HELPERS + get_master_helper(key)];
+    // отрезки не объединяются через неизменённые элементы: их могли изменить другие процессы
+    for (int first = 0; first < memory->quantum_size; ) {
+        if (!is_changed(first)) {
+            ++first;
+            continue;
+        }
+        int last = first + 1;
+        while (last < memory->quantum_size && is_changed(last))
+            ++last;
+        requests.insert(requests.end(), {DIFF, key, quantum_index, first, last - first});
+        size_t pos = requests.size();
+        requests.resize(pos + get_payload_records(&requests[pos - REQUEST_SIZE]) * REQUEST_SIZE, 0);
+        requests[pos] = rank;
+        std::memcpy(&requests[pos + 1], data + size_t(first) * size_of, size_t(last - first) * size_of);
+        ++accumulates_in_flight;
+        if ((int)requests.size() >= ACCUMULATE_BATCH * REQUEST_SIZE) {
+            flush_requests();
+        }
+        first = last;
+    }
+    // копия устарела: после смены режима квант снова запрашивается у каталога
+    quantum.mutex->lock();
+    quantum.version->fetch_add(1);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    retire(key, quantum_index);
+    memory->allocator.free(reinterpret_cast<char**>(&(quantum.twin)));
+    quantum.version->fetch_add(3, std::memory_order_release);
+    quantum.mutex->unlock();
+}
+
+void memory_manager::finish_ready_pending() {
+    flush_requests();  // SET_INFO по уже завершённым запросам отправляются до блокирующего ожидания
+    int index = MPI_UNDEFINED, flag = 0;
+    MPI_Waitany(2 * MAX_PENDING_REQUESTS, pending_info.data(), &index, MPI_STATUS_IGNORE);
+    CHECK(index != MPI_UNDEFINED, STATUS_ERR_UNKNOWN);
+    while (index != MPI_UNDEFINED) {  // SET_INFO по всем завершённым запросам собираются в одну посылку каждой части каталога
+        int slot = index % MAX_PENDING_REQUESTS;
+        auto& data_request = pending_info[MAX_PENDING_REQUESTS + slot];
+        if (index == slot && data_request != MPI_REQUEST_NULL && (pending[slot].reply[0] == rank || pending[slot].reply[1] != -1)) {
+            MPI_Cancel(&data_request);  // данные уже у процесса или читаются через MPI_Get, пересылки не будет
+            MPI_Wait(&data_request, MPI_STATUS_IGNORE);
+        }
+        if (pending_info[slot] == MPI_REQUEST_NULL && data_request == MPI_REQUEST_NULL) {  // пришли и ответ каталога, и квант
+            finish_pending(slot);
+        }
+        MPI_Testany(2 * MAX_PENDING_REQUESTS, pending_info.data(), &index, &flag, MPI_STATUS_IGNORE);
+        if (!flag)
+            index = MPI_UNDEFINED;
+    }
+}
+
+void memory_manager::send_set_info(int key, int quantum_index, int from_rank) {
+    post_request(get_home(key, quantum_index), {SET_INFO, key, quantum_index, from_rank, get_slot(key, quantum_index)});
+}
+
+int memory_manager::get_payload_records(const int* record) {
+    int payload_size;  // номер процесса и значения
+    if (record[0] == ACCUMULATE || record[0] == FETCH_AND_OP) {
+        payload_size = int(sizeof(int)) + directory[record[1]]->size_of;
+    } else if (record[0] == DIFF) {
+        payload_size = int(sizeof(int)) + record[4] * directory[record[1]]->size_of;
+    } else {
+        return 0;
+    }
+    int record_size = REQUEST_SIZE * int(sizeof(int));
+    return (payload_size + record_size - 1) / record_size;
+}
+
+bool memory_manager::apply_local(int key, int quantum_index, int offset, int op, const char* value, char* old_value) {
+    auto* memory = memory_manager::memory[key];
+    auto& quantum = memory->quantums[quantum_index];
+    // квант READ_WRITE режима на процессе - единственная копия: даже если право владения уже передано, изменения уйдут вместе с квантом
+    quantum.mutex->lock();
+    bool is_local = !quantum.is_mode_changed && quantum.quantum != nullptr && !(quantum.version->load() & 2);
+    if (is_local) {
+        char* elem = reinterpret_cast<char*>(quantum.quantum) + size_t(offset) * memory->size_of;
+        std::memcpy(old_value, elem, memory->size_of);
+        memory->apply_op(op, elem, value);
+    }
+    quantum.mutex->unlock();
+    return is_local;
+}
+
+void memory_manager::post_accumulate(int key, int quantum_index, int offset, int op, const char* value, bool is_fetch) {
+    int home = get_home(key, quantum_index);
+    auto& requests = to_directory[home * NUMBER_OF_MASTER_HELPERS + get_master_helper(key)];
+    requests.insert(requests.end(), {is_fetch ? FETCH_AND_OP : ACCUMULATE, key, quantum_index, offset, op});
+    size_t pos = requests.size();
+    requests.resize(pos + get_payload_records(&requests[pos - REQUEST_SIZE]) * REQUEST_SIZE, 0);
+    requests[pos] = rank;
+    std::memcpy(&requests[pos + 1], value, memory[key]->size_of);
+    if (!is_fetch) {
+        ++accumulates_in_flight;
+        if ((int)requests.size() >= ACCUMULATE_BATCH * REQUEST_SIZE) {
+            flush_requests();
+        }
+    }
+}
+
+void memory_manager::apply_accumulate(int key, const int* record, std::vector<int>& acks) {
+    auto* memory = memory_manager::memory[key];
+    auto& quantum = memory->quantums[record[2]];
+    CHECK(quantum.quantum != nullptr, STATUS_ERR_NULLPTR);
+    char* elem = reinterpret_cast<char*>(quantum.quantum) + size_t(record[3]) * memory->size_of;
+    int from_rank = record[REQUEST_SIZE];
+    CHECK(from_rank > 0 && from_rank < size, STATUS_ERR_WRONG_RANK);
+    if (record[0] == DIFF) {  // запись отрезка изменённых элементов, о выполнении сообщается, как для ACCUMULATE
+        CHECK(record[3] >= 0 && record[4] > 0 && record[3] + record[4] <= memory->quantum_size, STATUS_ERR_OUT_OF_BOUNDS);
+        std::memcpy(elem, record + REQUEST_SIZE + 1, size_t(record[4]) * memory->size_of);
+        ++acks[from_rank];
+        return;
+    }
+    if (record[0] == FETCH_AND_OP) {
+        MPI_Send(elem, memory->size_of, MPI_BYTE, from_rank, GET_FETCH_RESULT_FROM_HELPER, MPI_COMM_WORLD);
+    } else {
+        ++acks[from_rank];
+    }
+    memory->apply_op(record[4], elem, reinterpret_cast<const char*>(record + REQUEST_SIZE + 1));
+}
+
+void memory_manager::send_accumulate_acks(std::vector<int>& acks) {
+    for (int to_rank = 1; to_rank < size; ++to_rank) {
+        if (acks[to_rank] > 0) {
+            MPI_Send(&acks[to_rank], 1, MPI_INT, to_rank, ACCUMULATE_DONE, MPI_COMM_WORLD);
+            acks[to_rank] = 0;
+        }
+    }
+}
+
+void memory_manager::wait_accumulates() {
+    std::lock_guard<std::recursive_mutex> lock(compute_mutex);
+    flush_requests();
+    while (accumulates_in_flight > 0) {
+        int count;
+        MPI_Status status;
+        MPI_Recv(&count, 1, MPI_INT, MPI_ANY_SOURCE, ACCUMULATE_DONE, MPI_COMM_WORLD, &status);
+        accumulates_in_flight -= count;
+    }
+}
+
+void memory_manager::post_request(int home, std::initializer_list<int> record) {
+    int key = record.begin()[1];
+    auto& requests = to_directory[home * NUMBER_OF_MASTER_HELPERS + get_master_helper(key)];
+    requests.insert(requests.end(), record);
+}
+
+void memory_manager::flush_requests() {
+    for (int i = 0; i < (int)to_directory.size(); ++i) {
+        if (!to_directory[i].empty()) {
+            int home = i / NUMBER_OF_MASTER_HELPERS, tag = SEND_DATA_TO_MASTER_HELPER + i % NUMBER_OF_MASTER_HELPERS;
+            MPI_Send(to_directory[i].data(), int(to_directory[i].size()), MPI_INT, home, tag, MPI_COMM_WORLD);
+#if (ENABLE_STATISTICS_COLLECTION)
+  #if (ENABLE_STATISTICS_MESSAGES_CNT)
+            count_messages(to_directory[i], records_cnt, messages_cnt);
+  #endif
+#endif
+            to_directory[i].clear();
+        }
+    }
+}
+
+void memory_manager::post_helper_request(int to_rank, std::initializer_list<int> record) {
+    to_helpers[to_rank].insert(to_helpers[to_rank].end(), record);
+}
+
+void memory_manager::flush_helper_requests() {
+    for (int to_rank = 1; to_rank < size; ++to_rank) {
+        if (!to_helpers[to_rank].empty()) {
+            MPI_Send(to_helpers[to_rank].data(), int(to_helpers[to_rank].size()), MPI_INT, to_rank, SEND_DATA_TO_HELPER, MPI_COMM_WORLD);
+#if (ENABLE_STATISTICS_COLLECTION)
+  #if (ENABLE_STATISTICS_MESSAGES_CNT)
+            std::lock_guard<std::mutex> lock(helper_statistics_mutex);
+            count_messages(to_helpers[to_rank], helper_records_cnt, helper_messages_cnt);
+  #endif
+#endif
+            to_helpers[to_rank].clear();
+        }
+    }
+}
+
+void memory_manager::count_messages(const std::vector<int>& message, std::vector<long long>& records, std::vector<long long>& messages) {
+    std::vector<bool> is_in_message(NUMBER_OF_OPERATIONS, false);  // посылка учитывается один раз для каждой операции, записи которой в ней есть
+    for (int pos = 0; pos < (int)message.size(); pos += REQUEST_SIZE) {
+        int operation = message[pos];
+        if (operation < 0 || operation >= NUMBER_OF_OPERATIONS)  // запись о завершении работы
+            continue;
+        ++records[operation];
+        if (!is_in_message[operation]) {
+            is_in_message[operation] = true;
+            ++messages[operation];
+        }
+        ++records[NUMBER_OF_OPERATIONS];
+        pos += get_payload_records(message.data() + pos) * REQUEST_SIZE;  // данные операций не считаются записями
+    }
+    ++messages[NUMBER_OF_OPERATIONS];
+}
+
+void memory_manager::write_messages_statistics() {
+#if (ENABLE_STATISTICS_COLLECTION)
+  #if (ENABLE_STATISTICS_MESSAGES_CNT)
+    std::ofstream messages_statistic;
+    messages_statistic.open(STATISTICS_OUTPUT_DIRECTORY + "messages_cnt_process_" + std::to_string(rank) + ".txt");
+    messages_statistic << "operation | records | messages (to directory, from worker) | records | messages (to helpers, from directory)\n";
+    for (int operation = 0; operation <= NUMBER_OF_OPERATIONS; ++operation) {
+        messages_statistic << (operation < NUMBER_OF_OPERATIONS ? get_operation_name(operation) : "TOTAL") << " " << records_cnt[operation] << " " << messages_cnt[operation] << " "
+                           << helper_records_cnt[operation] << " " << helper_messages_cnt[operation] << "\n";
+    }
+    messages_statistic.close();
+  #endif
+#endif
+}
+
+void memory_manager::range_access(int key, long long l, long long r, char* buffer, bool is_write) {
+    auto* memory = memory_manager::memory[key];
+    CHECK(l >= 0 && l <= r && r <= memory->logical_size, STATUS_ERR_OUT_OF_BOUNDS);
+    if (l == r)
+        return;
+    CHECK(buffer != nullptr, STATUS_ERR_NULLPTR);
+    std::lock_guard<std::recursive_mutex> lock(compute_mutex);
+    wait_all_pending();
+    int quantum_size = memory->quantum_size, size_of = memory->size_of;
+    // копирование части кванта quantum_index, попадающей в [l, r)
+    auto copy_quantum = [&](int quantum_index) {
+        long long first = (long long)quantum_index * quantum_size;
+        long long begin = std::max(l, first), end = std::min(r, first + quantum_size);
+        char* data = reinterpret_cast<char*>(memory->quantums[quantum_index].quantum) + (begin - first) * size_of;
+        if (is_write) {
+            std::memcpy(data, buffer + (begin - l) * size_of, (end - begin) * size_of);
+        } else {
+            std::memcpy(buffer + (begin - l) * size_of, data, (end - begin) * size_of);
+        }
+#ifdef ENABLE_STATISTICS_COLLECTION
+    #if (ENABLE_STATISTICS_QUANTUMS_CNT_WORKERS)
+        memory->quantums[quantum_index].cnt.back() += int(end - begin) - 1;
+    #endif
+#endif
+    };
+
+    std::vector<int> missing;  // кванты, запрашиваемые одной посылкой у каждой части каталога
+    std::vector<int> evicted;  // кванты, вытесненные из кеша недостающими квантами
+    int read_only_cnt = 0;
+    // отправка накопленных запросов частям каталога и получение всех недостающих квантов
+    auto flush = [&]() {
+        if (missing.empty())
+            return;
+        std::vector<std::vector<int>> items(size);  // номера в missing квантов, ответ по которым ожидается от каждой части каталога
+        for (int quantum_index: evicted) {
+            post_request(get_home(key, quantum_index), {EVICT, key, quantum_index, -1, -1});
+        }
+        for (int i = 0; i < (int)missing.size(); ++i) {
+            int home = get_home(key, missing[i]);
+            post_request(home, {TRY_GET_INFO, key, missing[i], -1, GET_RANGE_DATA_FROM_HELPER + i});
+            items[home].push_back(i);
+        }
+        flush_requests();  // вместе с запросами уходят SET_INFO по квантам, полученным предыдущей посылкой
+        std::vector<int> to_ranks(missing.size(), -2), slots(missing.size(), -1), reply;
+        for (int home = 0; home < size; ++home) {
+            if (!items[home].empty()) {
+                reply.resize(items[home].size() * REPLY_SIZE);
+                MPI_Status status;
+                MPI_Recv(reply.data(), int(reply.size()), MPI_INT, home, GET_INFO_FROM_MASTER_HELPER, MPI_COMM_WORLD, &status);
+                for (int j = 0; j < (int)items[home].size(); ++j) {
+                    to_ranks[items[home][j]] = reply[j * REPLY_SIZE];
+                    slots[items[home][j]] = reply[j * REPLY_SIZE + 1];
+                }
+            }
+        }
+        // копирование полученного кванта; после set_received отложенный запрос GET_DATA_RW может сразу забрать квант
+        auto finish = [&](int i) {
+            int quantum_index = missing[i], to_rank = to_ranks[i];
+            reset_mode_changed(key, quantum_index);
+            CHECK(memory->quantums[quantum_index].quantum != nullptr, STATUS_ERR_NULLPTR);
+            make_twin(key, quantum_index, to_rank);
+            copy_quantum(quantum_index);
+            set_received(key, quantum_index);
+            if (memory->quantums[quantum_index].mode == READ_ONLY) {
+                if (to_rank == rank)  // данные уже у процесса, уведомлять каталог не нужно
+                    return;
+                memory->quantums[quantum_index].owner_hint = to_rank;
+            }
+            send_set_info(key, quantum_index, (to_rank != rank) ? to_rank : -1);  // уведомление каталога о готовности полученных квантов
+        };
+        // части каталога обращаются к рабочим независимо, поэтому кванты могут прийти в любом порядке:
+        // каждый квант принимается неблокирующим приёмом со своим тегом
+        std::vector<MPI_Request> receives;
+        std::vector<int> received_items;  // номера в missing квантов, принимаемых через receives
+        std::vector<int> read_items;  // номера в missing квантов, читаемых через MPI_Get
+        receives.reserve(missing.size());
+        for (int i = 0; i < (int)missing.size(); ++i) {
+            int quantum_index = missing[i], to_rank = to_ranks[i];
+            auto& quantum = memory->quantums[quantum_index];
+            if (to_rank == rank) {
+                finish(i);
+                continue;
+            }
+            CHECK(to_rank > 0 && to_rank < size, STATUS_ERR_WRONG_RANK);
+            if (slots[i] != -1) {  // квант читается из памяти владельца
+                read_quantum(key, quantum_index, to_rank, slots[i]);
+                read_items.push_back(i);
+                continue;
+            }
+            receives.emplace_back();
+            received_items.push_back(i);
+            MPI_Irecv(quantum.quantum, quantum_size, memory->type, to_rank, GET_RANGE_DATA_FROM_HELPER + i, MPI_COMM_WORLD, &receives.back());
+        }
+        wait_reads(key);
+        for (int i: read_items) {
+            finish(i);
+        }
+        // владелец может пересылать квант только после того, как сам его получит, поэтому каждый квант
+        // завершается сразу по приёму: ожидание всех квантов сразу могло бы заблокировать встречную пересылку
+        for (int k = 0; k < (int)receives.size(); ++k) {
+            int index = MPI_UNDEFINED;
+            MPI_Waitany(int(receives.size()), receives.data(), &index, MPI_STATUS_IGNORE);
+            finish(received_items[index]);
+        }
+        missing.clear();
+        evicted.clear();
+        read_only_cnt = 0;
+    };
+
+    for (int quantum_index = get_quantum_index(key, l); quantum_index <= get_quantum_index(key, r - 1); ++quantum_index) {
+        auto& quantum = memory->quantums[quantum_index];
+        if (is_write) {
+            CHECK(quantum.mode != READ_ONLY, STATUS_ERR_ILLEGAL_WRITE);  // запись в READ_ONLY режиме запрещена
+        }
+        quantum.mutex->lock();
+        if (!quantum.is_mode_changed && quantum.quantum != nullptr) {  // квант на данном процессе, обращение к каталогу не требуется
+#ifdef ENABLE_STATISTICS_COLLECTION
+    #if (ENABLE_STATISTICS_QUANTUMS_CNT_WORKERS)
+            ++quantum.cnt.back();
+    #endif
+#endif
+            copy_quantum(quantum_index);
+            quantum.mutex->unlock();
+            continue;
+        }
+        quantum.mutex->unlock();
+#ifdef ENABLE_STATISTICS_COLLECTION
+    #if (ENABLE_STATISTICS_QUANTUMS_CNT_WORKERS)
+        collect_statistic_worker(key, quantum_index);
+        quantum.cnt.push_back(1);
+        quantum.modes.push_back(quantum.mode);
+    #endif
+#endif
+        // работа с кешем
+        if (quantum.is_mode_changed && quantum.mode != READ_ONLY) {
+            if (memory->cache.is_contain(quantum_index)) {
+                memory->cache.delete_elem(quantum_index);
+            }
+        }
+        if (missing.size() == MAX_QUANTUMS_IN_REQUEST) {
+            flush();
+        }
+        if (quantum.mode == READ_ONLY) {
+            // вытесняемый квант не должен оказаться среди ещё не полученных квантов, поэтому по бюджету кеша вытесняются только кванты других структур
+            if (read_only_cnt == memory->cache.get_cache_size()) {
+                flush();
+            }
+            int removing_quantum_index = cache_add(key, quantum_index, false);
+            if (removing_quantum_index >= 0) {
+                evicted.push_back(removing_quantum_index);
+            }
+            ++read_only_cnt;
+        }
+        reserve_quantum(key, quantum_index);
+        missing.push_back(quantum_index);
+    }
+    flush();  // SET_INFO по полученным квантам уходят со следующей посылкой
+}
+
 void memory_manager::print(int key, const std::string& path) {
+    std::lock_guard<std::recursive_mutex> lock(compute_mutex);
+    wait_all_pending();
     int err = MPI_File_open(workers_comm, path.data(), MPI_MODE_WRONLY | MPI_MODE_CREATE | MPI_MODE_APPEND, MPI_INFO_NULL, &fh);\
     CHECK(!err, STATUS_ERR_FILE_OPEN);
-    int request[4] = {PRINT, key, -1, -1};
-    MPI_Send(request, 4, MPI_INT, 0, SEND_DATA_TO_MASTER_HELPER, MPI_COMM_WORLD);
-    int is_ready;
-    MPI_Status status;
-    MPI_Recv(&is_ready, 1, MPI_INT, 0, GET_PERMISSION_TO_CONTINUE, MPI_COMM_WORLD, &status);
+    // печать выполняется каждой непустой частью каталога для своих квантов
+    int num_of_quantums = int((memory[key]->logical_size + memory[key]->quantum_size - 1) / memory[key]->quantum_size);
+    for (int home = 0; home < size; ++home) {
+        if (get_first_quantum(num_of_quantums, home) < get_first_quantum(num_of_quantums, home + 1))
+            post_request(home, {PRINT, key, -1, -1, -1});
+    }
+    flush_requests();
+    for (int home = 0; home < size; ++home) {
+        if (get_first_quantum(num_of_quantums, home) < get_first_quantum(num_of_quantums, home + 1)) {
+            int is_ready;
+            MPI_Status status;
+            MPI_Recv(&is_ready, 1, MPI_INT, home, GET_PERMISSION_TO_CONTINUE, MPI_COMM_WORLD, &status);
+        }
+    }
     MPI_File_close(&fh);
 }
 
 void memory_manager::print_quantum(int key, int quantum_index) {
     CHECK(memory_manager::rank >= 1 && memory_manager::rank < size, STATUS_ERR_WRONG_RANK);
-    auto* memory = dynamic_cast<memory_line_worker*>(memory_manager::memory[key]);
+    auto* memory = memory_manager::memory[key];
     CHECK(memory->quantums[quantum_index].quantum != nullptr, STATUS_ERR_NULLPTR);
     MPI_Status status;
-    MPI_File_write_at(fh, quantum_index * memory->quantum_size * memory->size_of, memory->quantums[quantum_index].quantum, std::min(memory->logical_size, memory->quantum_size), memory->type, &status);
+    MPI_File_write_at(fh, MPI_Offset(quantum_index) * memory->quantum_size * memory->size_of, memory->quantums[quantum_index].quantum,
+                      int(std::min<long long>(memory->logical_size, memory->quantum_size)), memory->type, &status);
     std::cout<<std::flush;
 }
 
 MPI_Datatype memory_manager::get_MPI_datatype(int key) {
-    return dynamic_cast<memory_line_worker*>(memory_manager::memory[key])->type;
+    return memory_manager::memory[key]->type;
 }
 
 void memory_manager::wait_all() {
+    wait_accumulates();
     MPI_Barrier(MPI_COMM_WORLD);
 }
 
 void memory_manager::wait_all_workers() {
-    if (rank != 0)
+    if (rank != 0) {
+        wait_accumulates();
         MPI_Barrier(workers_comm);
+    }
 }
 
 int memory_manager::wait() {
@@ -524,16 +1868,41 @@ void memory_manager::wait(int from_rank) {
 }
 
 void memory_manager::notify(int to_rank) {
+    wait_accumulates();  // процесс to_rank увидит результаты accumulate данного процесса
     char x = 42;
     MPI_Send(&x, 1, MPI_CHAR, to_rank, NOTIFY, MPI_COMM_WORLD);
 }
 
 void memory_manager::finalize() {
+    if (rank != 0) {
+        std::lock_guard<std::recursive_mutex> lock(compute_mutex);
+        wait_all_pending();
+        wait_accumulates();  // вспомогательные потоки выполняют все операции до завершения работы
+        for (auto& requests: to_directory) {  // уведомление всех потоков всех частей каталога о завершении работы
+            requests.insert(requests.end(), {-1, -1, -1, -1, -1});
+        }
+        flush_requests();
+    }
+    for (auto& master_helper_thr: master_helper_thrs) {
+        CHECK(master_helper_thr.joinable(), STATUS_ERR_UNKNOWN);
+        master_helper_thr.join();  // часть каталога завершает работу после уведомлений от всех рабочих
+    }
+    write_messages_statistics();
+    // после синхронизации ни одна часть каталога не обращается к вспомогательным потокам рабочих
     if (rank != 0) {
         int tmp = 1;
         MPI_Send(&tmp, 1, MPI_INT, 0, FINALIZE_WORKER, MPI_COMM_WORLD);
         MPI_Status status;
         MPI_Recv(&tmp, 1, MPI_INT, 0, FINALIZE_MASTER, MPI_COMM_WORLD, &status);
+#if (ENABLE_RMA_READ_ONLY)
+        for (auto* line_worker: memory) {  // окна закрываются коллективно всеми рабочими, чтений через MPI_Get больше нет
+            if (line_worker == nullptr || line_worker->win == MPI_WIN_NULL)
+                continue;
+            MPI_Win_unlock_all(line_worker->win);
+            line_worker->allocator.detach();
+            MPI_Win_free(&line_worker->win);
+        }
+#endif
     } else {
         int tmp;
         for (int i = 1; i < size; ++i) {
@@ -544,58 +1913,177 @@ void memory_manager::finalize() {
             MPI_Send(&tmp, 1, MPI_INT, i, FINALIZE_MASTER, MPI_COMM_WORLD);
         }
     }
-    if (rank == 0) {
-        int request[4] = {-1, -1, -1, -1};
-        for (int i = 1; i < size; ++i) {
-            MPI_Send(request, 4, MPI_INT, i, SEND_DATA_TO_HELPER, MPI_COMM_WORLD);  // завершение работы вспомогательных потоков процессов рабочих
-        }
-    } else if (rank == 1) {
-        int request[4] = {-1, -1, -1, -1};
-        MPI_Send(request, 3, MPI_INT, 0, SEND_DATA_TO_MASTER_HELPER, MPI_COMM_WORLD);  // завершение работы вспомогательного потока процесса-мастера
-    }
-    CHECK(helper_thr.joinable(), STATUS_ERR_UNKNOWN);
-    helper_thr.join();
-    // if (rank != 0) {
-    //     for (int key = 0; key < (int)memory.size(); ++key) {
-    //         auto* memory = dynamic_cast<memory_line_worker*>(memory_manager::memory[key]);
-    //         assert(memory[key].wait_quantums.size() == 0);
-    //         if (!memory_manager::is_read_only_mode) {
-    //             for (int quantum = 0; quantum < (int)memory[key].quantum_owner.size(); ++quantum) {
-    //                 assert(memory[key].quantum_owner[quantum].first == true);
-    //             }
-    //         }
-    //         for (int i = 0; i < (int)memory->quantums.size(); ++i) {
-    //             assert(memory[key].quantums[i] == nullptr);
-    //         }
-    //     }
-    // }
+    if (rank != 0) {
+        int request[REQUEST_SIZE] = {-1, -1, -1, -1, -1};
+        MPI_Send(request, REQUEST_SIZE, MPI_INT, rank, SEND_DATA_TO_HELPER, MPI_COMM_WORLD);  // завершение работы вспомогательного потока
+        CHECK(helper_thr.joinable(), STATUS_ERR_UNKNOWN);
+        helper_thr.join();
+    } else {
+        for (auto line: memory) {
+            delete line;
+        }
+    }
+    is_finalized = true;
     MPI_Finalize();
 }
 
+int memory_manager::handle_get_info(int key, int quantum_index, int requesting_process, int data_tag, int& slot) {
+    auto* memory = directory[key];
+    int local_index = quantum_index - memory->first_quantum_index;
+    auto& quantum = memory->quantums[local_index];
+    int to_rank = -1;
+    slot = -1;
+    if (quantum.mode == READ_ONLY) {
+        if (quantum.is_mode_changed) {  // был переход между режимами?
+            CHECK(!quantum.owners.empty(), STATUS_ERR_READ_UNINITIALIZED_DATA);  // квант не был инициализирован
+            CHECK(quantum.quantum_ready == true, STATUS_ERR_UNKNOWN);
+            // несколько владельцев остаются, если квант не записывался в READ_WRITE режиме после прошлого READ_ONLY:
+            // их копии одинаковы и не освобождались
+            quantum.is_mode_changed = false;
+        }
+        CHECK(!quantum.owners.empty(), STATUS_ERR_READ_UNINITIALIZED_DATA);  // квант не был инициализирован
+
+        to_rank = get_owner(key, quantum_index, requesting_process);  // получение ранга наиболее предпочтительного процесса
+        CHECK(to_rank > 0 && to_rank < size, STATUS_ERR_WRONG_RANK);
+        if (to_rank != requesting_process) {
+            ++quantum.requests[to_rank - 1];  // квант не удаляется у владельца до SET_INFO от запросившего процесса
+#if (ENABLE_RMA_READ_ONLY)
+            slot = quantum.slots[to_rank - 1];
+            if (slot != -1) {  // процесс прочитает квант через MPI_Get
+                return to_rank;
+            }
+#endif
+            post_helper_request(to_rank, {GET_DATA_R, key, quantum_index, requesting_process, data_tag});  // запрос вспомогательному потоку
+                                                                                                            // процесса-рабочего о пересылке данных
+        }
+        return to_rank;
+    }
+
+    if (quantum.mode == WRITE_SHARED) {  // копию пересылает владелец, он же примет изменения копии
+        quantum.is_mode_changed = false;
+        if (quantum.owners.empty()) {  // данные ранее не запрашивались?
+            quantum.quantum_ready = true;
+            quantum.owners.push_back(requesting_process);
+            return requesting_process;
+        }
+        to_rank = quantum.owners.front();
+        CHECK(to_rank > 0 && to_rank < size, STATUS_ERR_WRONG_RANK);
+        if (to_rank != requesting_process) {
+            ++quantum.requests[to_rank - 1];
+            post_helper_request(to_rank, {GET_DATA_R, key, quantum_index, requesting_process, data_tag});
+        }
+        return to_rank;
+    }
+
+    // READ_WRITE mode
+    if (quantum.is_mode_changed) {  // был переход между режимами?
+        to_rank = get_owner(key, quantum_index, requesting_process);  // получение ранга наиболее предпочтительного процесса
+        quantum.is_mode_changed = false;
+        quantum.owners.clear();  // TODO: send to all quantums to free memory?
+        quantum.quantum_ready = false;
+        quantum.owners.push_back(requesting_process);
+        if (to_rank == -1 || to_rank == requesting_process) {  // данные у процесса, отправившего запрос?
+            return requesting_process;
+        }
+        CHECK(to_rank > 0 && to_rank < size, STATUS_ERR_WRONG_RANK);
+        ++quantum.requests[to_rank - 1];
+        // копия, полученная в READ_ONLY режиме, пересылается без ожидания: её владелец сам может ждать этот квант в очереди передачи права владения
+        post_helper_request(to_rank, {GET_DATA_R, key, quantum_index, requesting_process, data_tag});
+        return to_rank;
+    } else if (quantum.owners.empty()) {  // данные ранее не запрашивались?
+        quantum.quantum_ready = false;
+        quantum.owners.push_back(requesting_process);
+        return requesting_process;  // процесс, отправивший запрос, может забрать квант без пересылок данных
+    }
+    // право владения передаётся сразу, даже если владелец ещё не получил квант: его вспомогательный поток
+    // отложит пересылку до приёма кванта, поэтому запросы не ждут SET_INFO в каталоге
+    CHECK(quantum.owners.size() == 1, STATUS_ERR_UNKNOWN);
+    to_rank = quantum.owners.front();
+    CHECK(to_rank > 0 && to_rank < size && to_rank != requesting_process, STATUS_ERR_WRONG_RANK);
+    quantum.quantum_ready = false;
+    quantum.owners.pop_front();
+    quantum.owners.push_back(requesting_process);
+    ++quantum.migrations;
+    ++quantum.requests[to_rank - 1];
+    post_helper_request(to_rank, {GET_DATA_RW, key, quantum_index, requesting_process, data_tag});  // запрос вспомогательному потоку
+                                                                                                     // процесса-рабочего о пересылке данных
+    return to_rank;
+}
+
+void memory_manager::handle_set_info(int key, int quantum_index, int sender_process, int requesting_process, int slot) {
+    auto* memory = directory[key];
+    int local_index = quantum_index - memory->first_quantum_index;
+    auto& quantum = memory->quantums[local_index];
+#if (ENABLE_RMA_READ_ONLY)
+    quantum.slots[requesting_process - 1] = slot;
+#else
+    (void)slot;
+#endif
+    if (sender_process > 0) {
+        CHECK(sender_process < size, STATUS_ERR_OUT_OF_BOUNDS);
+        // уменьшить счётчик для кванта и процесса, посылавшего квант на процесс requesting_process
+        --quantum.requests[sender_process - 1];
+        CHECK(quantum.requests[sender_process - 1] >= 0, STATUS_ERR_UNKNOWN);
+        // для данного процесса и кванта незаконченных запросов не осталось?
+        if (quantum.requests[sender_process - 1] == 0 && quantum.want_to_delete[sender_process - 1]) {
+            quantum.want_to_delete[sender_process - 1] = false;
+            post_helper_request(sender_process, {DELETE, key, quantum_index, -1, -1});
+        }
+    }
+
+    if (quantum.mode == READ_ONLY) {
+        if (quantum.is_mode_changed) {  // копия получена рассылкой при смене режима, единственный владелец - прежний владелец в READ_WRITE режиме
+            CHECK(quantum.quantum_ready == true && quantum.owners.size() == 1, STATUS_ERR_UNKNOWN);
+            quantum.is_mode_changed = false;
+        }
+        quantum.owners.push_back(requesting_process);  // процесс помещается в вектор процессов,
+                                                       // которые могут пересылать данный квант другим процессам
+        return;
+    }
+    if (quantum.mode == WRITE_SHARED)  // получатель копии владельцем не становится
+        return;
+    // READ_WRITE mode: квант готов, если SET_INFO пришёл от последнего владельца; право владения могло уже перейти дальше
+    if (quantum.owners.front() == requesting_process) {
+        CHECK(quantum.quantum_ready == false, STATUS_ERR_UNKNOWN);
+        quantum.quantum_ready = true;
+    }
+}
+
 int memory_manager::get_owner(int key, int quantum_index, int requesting_process) {
-    auto* memory = dynamic_cast<memory_line_master*>(memory_manager::memory[key]);
-    CHECK(!memory->quantums[quantum_index].owners.empty(), STATUS_ERR_READ_UNINITIALIZED_DATA);
-    for (auto rank: memory->quantums[quantum_index].owners)
+    auto& owners = directory[key]->quantums[quantum_index - directory[key]->first_quantum_index].owners;
+    CHECK(!owners.empty(), STATUS_ERR_READ_UNINITIALIZED_DATA);
+    for (auto rank: owners)
         if (rank == requesting_process)
             return requesting_process;
-    int to_rank = memory->quantums[quantum_index].owners.front();
-    memory->quantums[quantum_index].owners.pop_front();
-    memory->quantums[quantum_index].owners.push_back(to_rank);
+    int to_rank = owners.front();
+    owners.pop_front();
+    owners.push_back(to_rank);
     return to_rank;
 }
 
 void memory_manager::remove_owner(int key, int removing_quantum_index, int process) {
-    auto* memory = dynamic_cast<memory_line_master*>(memory_manager::memory[key]);
-    CHECK(!memory->quantums[removing_quantum_index].owners.empty(), STATUS_ERR_UNKNOWN);
-    for (auto rank = memory->quantums[removing_quantum_index].owners.begin();
-                        rank  < memory->quantums[removing_quantum_index].owners.end(); ++rank) {
+    auto& owners = directory[key]->quantums[removing_quantum_index - directory[key]->first_quantum_index].owners;
+    CHECK(!owners.empty(), STATUS_ERR_UNKNOWN);
+    for (auto rank = owners.begin(); rank < owners.end(); ++rank) {
         if (*rank == process) {
-            memory->quantums[removing_quantum_index].owners.erase(rank);
+            owners.erase(rank);
             break;
         }
     }
 }
 
 void memory_manager::collect_statistic_worker(int key, int quantum_index) {
-
+#if (ENABLE_STATISTICS_COLLECTION)
+    #if (ENABLE_STATISTICS_QUANTUMS_CNT_WORKERS)
+    auto& quantum = memory_manager::memory[key]->quantums[quantum_index];
+    int hits = quantum.hits->exchange(0);
+    if (hits > 0) {
+        if (quantum.cnt.empty()) {
+            quantum.cnt.push_back(0);
+            quantum.modes.push_back(quantum.mode);
+        }
+        quantum.cnt.back() += hits;
+    }
+    #endif
+#endif
 }
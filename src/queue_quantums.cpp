@@ -8,15 +8,15 @@ queue_quantums::queue_quantums(int num_quantums) {
     MPI_Comm_rank(MPI_COMM_WORLD, &rank);
 }
 
-void queue_quantums::push(int quantum_number, int process) {
+void queue_quantums::push(int quantum_number, int process, int reply_tag) {
     CHECK(quantum_number >= 0 && quantum_number < (int)v_queues.size(), STATUS_ERR_OUT_OF_BOUNDS);
-    v_queues[quantum_number].push(process);
+    v_queues[quantum_number].push({process, reply_tag});
 }
 
-int queue_quantums::pop(int quantum_number) {
+waiting_process queue_quantums::pop(int quantum_number) {
     CHECK(quantum_number >= 0 && quantum_number < (int)v_queues.size(), STATUS_ERR_OUT_OF_BOUNDS);
     CHECK(is_contain(quantum_number), STATUS_ERR_UNKNOWN); // make another new error?
-    int process =  v_queues[quantum_number].front();
+    waiting_process process = v_queues[quantum_number].front();
     v_queues[quantum_number].pop();
     return process;
 }